@@ -0,0 +1,176 @@
+/* module execution microbenchmarks, prints one JSON object on stdout */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "defs.h"
+#include "modules.h"
+
+Config config;
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int n, double p)
+{
+	return sorted[(int)(p / 100.0 * (n - 1) + 0.5)];
+}
+
+static void setup_modules(int n)
+{
+	cleanup_modules(&config);
+	arena_free(&config.arena);
+	config.modules = calloc(n, sizeof(Module));
+	config.module_count = config.max_modules = n;
+	for (int i = 0; i < n; i++) {
+		config.modules[i].enabled = 1;
+		config.modules[i].refresh_interval = 1000;
+	}
+}
+
+/* time one forced refresh of module 0 per iteration */
+static void bench_spawn(const char *label, const char *cmd, int iterations, int last)
+{
+	double *t = malloc(iterations * sizeof *t);
+	setup_modules(1);
+	config.modules[0].command = arena_strdup(&config.arena, cmd);
+
+	for (int i = 0; i < iterations; i++) {
+		config.modules[0].last_update = 0;
+		double t0 = now_us();
+		update_modules();
+		t[i] = now_us() - t0;
+	}
+	qsort(t, iterations, sizeof *t, cmp_double);
+
+	double sum = 0;
+	for (int i = 0; i < iterations; i++) {
+		sum += t[i];
+	}
+	printf("\t\t\"%s\": {\"iterations\": %d, \"mean_us\": %.1f, "
+			"\"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f}%s\n",
+			label, iterations, sum / iterations, percentile(t, iterations, 50),
+			percentile(t, iterations, 99), t[iterations - 1], last ? "" : ",");
+	free(t);
+}
+
+/* line_len 0 captures one unbroken line, otherwise many newline-terminated ones */
+static void bench_capture(const char *label, long bytes, int line_len, int last)
+{
+	char cmd[160];
+	if (line_len > 0) {
+		snprintf(cmd, sizeof cmd, "yes %.*s | head -c %ld", line_len - 1,
+				"0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef", bytes);
+	}
+	else {
+		snprintf(cmd, sizeof cmd, "head -c %ld /dev/zero | tr '\\0' a", bytes);
+	}
+	setup_modules(1);
+	config.modules[0].command = arena_strdup(&config.arena, cmd);
+
+	double t0 = now_us();
+	update_modules();
+	double dt = now_us() - t0;
+	size_t got = config.modules[0].cached_output ? strlen(config.modules[0].cached_output) : 0;
+
+	printf("\t\t\"%s\": {\"bytes\": %ld, \"line_len\": %d, \"captured\": %zu, "
+			"\"seconds\": %.4f, \"mb_per_s\": %.2f}%s\n",
+			label, bytes, line_len, got, dt / 1e6, bytes / dt, last ? "" : ",");
+}
+
+/* modules with empty commands never fork, so this isolates the scheduling loop */
+static void bench_schedule(int n, int calls, int last)
+{
+	setup_modules(n);
+	long long now = monotonic_ms();
+	for (int i = 0; i < n; i++) {
+		config.modules[i].command = arena_strdup(&config.arena, "");
+		config.modules[i].refresh_interval = (1 + (i * 7) % 60) * 1000;
+		config.modules[i].last_update = now;
+	}
+
+	double t0 = now_us();
+	for (int i = 0; i < calls; i++) {
+		update_modules();
+	}
+	double dt = now_us() - t0;
+
+	printf("\t\t\"modules_%d\": {\"calls\": %d, \"ns_per_call\": %.1f, \"ns_per_module\": %.2f}%s\n",
+			n, calls, dt * 1e3 / calls, dt * 1e3 / calls / n, last ? "" : ",");
+}
+
+/* one due module among many idle ones: time until its cached_output changes */
+static void bench_refresh_latency(int n, int iterations)
+{
+	double *t = malloc(iterations * sizeof *t);
+	setup_modules(n);
+	long long now = monotonic_ms();
+	for (int i = 0; i < n; i++) {
+		config.modules[i].command = arena_strdup(&config.arena, i == n / 2 ? "echo tick" : "");
+		config.modules[i].refresh_interval = 60000;
+		config.modules[i].last_update = now;
+	}
+
+	Module *m = &config.modules[n / 2];
+	for (int i = 0; i < iterations; i++) {
+		module_set_output(m, NULL);
+		m->last_update = 0;
+		double t0 = now_us();
+		update_modules();
+		t[i] = m->cached_output ? now_us() - t0 : -1;
+	}
+	qsort(t, iterations, sizeof *t, cmp_double);
+
+	printf("\t\"refresh_latency\": {\"modules\": %d, \"iterations\": %d, \"p50_us\": %.1f, "
+			"\"p99_us\": %.1f, \"max_us\": %.1f}\n",
+			n, iterations, percentile(t, iterations, 50), percentile(t, iterations, 99),
+			t[iterations - 1]);
+	free(t);
+}
+
+int main(int ac, char **av)
+{
+	int iterations = ac > 1 ? atoi(av[1]) : 200;
+	if (iterations <= 0) {
+		iterations = 200;
+	}
+
+	printf("{\n\t\"version\": \"%s\",\n", SXBAR_VERSION);
+
+	printf("\t\"spawn\": {\n");
+	bench_spawn("true", "true", iterations, 0);
+	bench_spawn("echo", "echo ok", iterations, 0);
+	bench_spawn("pipeline", "echo 42 | sed 's/$/%/'", iterations, 1);
+	printf("\t},\n");
+
+	printf("\t\"capture\": {\n");
+	bench_capture("single_line_1m", 1L << 20, 0, 0);
+	bench_capture("lines_64b_256k", 256L << 10, 64, 0);
+	bench_capture("lines_16b_256k", 256L << 10, 16, 1);
+	printf("\t},\n");
+
+	printf("\t\"schedule\": {\n");
+	bench_schedule(10, 100000, 0);
+	bench_schedule(100, 100000, 0);
+	bench_schedule(500, 20000, 1);
+	printf("\t},\n");
+
+	bench_refresh_latency(500, iterations);
+	printf("}\n");
+
+	cleanup_modules(&config);
+	return 0;
+}
@@ -0,0 +1,53 @@
+/* settings of a make CONFIG=static build, copied to config.h on first build: edit that copy */
+
+/* layout and style; BAR_POS_TOP, BAR_POS_BOTTOM, BAR_POS_LEFT or BAR_POS_RIGHT */
+#define BAR_POSITION		BAR_POS_BOTTOM
+#define HEIGHT				19
+#define VERTICAL_PADDING	0
+#define HORIZONTAL_PADDING	0
+#define TEXT_PADDING		0
+#define BORDER				False
+#define BORDER_WIDTH		0
+#define BACKGROUND_COLOUR	"#171717"
+#define FOREGROUND_COLOUR	"#fffde0"
+#define BORDER_COLOUR		"#717394"
+#define FONT				"monospace"
+#define FONT_SIZE			14
+#define FONT_FALLBACK		NULL	/* e.g. "Symbols Nerd Font, Noto Color Emoji" */
+
+/* modules, every interval in milliseconds */
+#define MARQUEE_FPS			30
+#define BATTERY_MULTIPLIER	1
+#define TIMER_SLACK			200
+
+/*
+ * field names as in struct Module; path must be absolute, a missing interval means 1s;
+ * .monitor_mask (a bit per monitor) and .on_primary limit a module to some bars;
+ * .on_click, .on_scroll_up and .on_scroll_down run in the background on the slot
+ */
+static const Module module_table[] = {
+	{.name = "clock", .command = "date '+%H:%M:%S'", .enabled = True, .refresh_interval = 1000},
+	{.name = "date", .command = "date '+%Y-%m-%d'", .enabled = True, .refresh_interval = 60000,
+		.backoff = 3, .max_interval = 600000},
+	{.name = "volume", .command = "amixer get Master | grep -o '[0-9]*%' | head -1 || echo 'N/A'",
+		.enabled = True, .refresh_interval = 5000, .on_click = "amixer -q set Master toggle",
+		.on_scroll_up = "amixer -q set Master 5%+", .on_scroll_down = "amixer -q set Master 5%-"},
+	{.name = "mem", .command = "free -h | awk '/^Mem/ { print $3 }' | sed s/i//g",
+		.enabled = True, .refresh_interval = 3000},
+	{.name = "title", .type = MODULE_WINDOW_TITLE, .enabled = False, .max_width = 300,
+		.marquee = True},
+};
+
+/* workspaces; WS_POS_LEFT, WS_POS_CENTER or WS_POS_RIGHT */
+static const char *ws_label_table[] = {
+	"one", "two", "three", "four", "five", "six", "seven", "eight", "nine",
+};
+#define WS_ACTIVE_BACKGROUND	"#717394"
+#define WS_ACTIVE_FOREGROUND	"#fffde0"
+#define WS_INACTIVE_BACKGROUND	"#171717"
+#define WS_INACTIVE_FOREGROUND	"#fffde0"
+#define WS_PADDING_LEFT			10
+#define WS_PADDING_RIGHT		10
+#define WS_SPACING				0
+#define WS_POSITION				WS_POS_LEFT
+#define WS_PER_MONITOR			False	/* desktop per monitor, charged by pointer position */
@@ -0,0 +1,111 @@
+/*
+ * Arena for config-lifetime data. Strings and tables parsed from the config are carved out
+ * of a few large blocks instead of one malloc each, and the whole config is dropped on
+ * reload by freeing the blocks, so a bar running for weeks does not fragment its heap.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define BLOCK_SIZE	4096
+#define ALIGN		(2 * sizeof(void *))
+
+struct ArenaBlock {
+	ArenaBlock *next;
+	size_t len;
+	size_t cap;
+	union {
+		void *p;
+		long long ll;
+		double d;
+	} data[];
+};
+
+void *arena_alloc(Arena *a, size_t n)
+{
+	n = (n + ALIGN - 1) & ~(ALIGN - 1);
+	ArenaBlock *b = a->head;
+	if (!b || b->cap - b->len < n) {
+		/* oversized requests get a block of their own behind the current one */
+		size_t cap = n > BLOCK_SIZE - sizeof *b ? n : BLOCK_SIZE - sizeof *b;
+		ArenaBlock *nb = malloc(sizeof *nb + cap);
+		if (!nb) {
+			return NULL;
+		}
+		nb->len = 0;
+		nb->cap = cap;
+		if (b && cap > BLOCK_SIZE - sizeof *b) {
+			nb->next = b->next;
+			b->next = nb;
+		}
+		else {
+			nb->next = b;
+			a->head = nb;
+		}
+		a->size += sizeof *nb + cap;
+		b = nb;
+	}
+	void *p = (char *)b->data + b->len;
+	b->len += n;
+	a->used += n;
+	return p;
+}
+
+char *arena_strndup(Arena *a, const char *s, size_t n)
+{
+	n = strnlen(s, n);
+	char *d = arena_alloc(a, n + 1);
+	if (d) {
+		memcpy(d, s, n);
+		d[n] = '\0';
+	}
+	return d;
+}
+
+char *arena_strdup(Arena *a, const char *s)
+{
+	return arena_strndup(a, s, strlen(s));
+}
+
+/*
+ * split a list of nul separated strings (an X text property) into a table that shares one
+ * malloc block with copies of the strings, so the whole list goes with a single free()
+ */
+char **strlist_pack(const char *data, size_t len, int max, int *count)
+{
+	int n = 0;
+	for (size_t off = 0; off < len && n < max; n++) {
+		off += strnlen(data + off, len - off) + 1;
+	}
+	*count = n;
+	if (!n) {
+		return NULL;
+	}
+
+	char **list = malloc(n * sizeof *list + len + 1);
+	if (!list) {
+		*count = 0;
+		return NULL;
+	}
+	char *strs = (char *)(list + n);
+	memcpy(strs, data, len);
+	strs[len] = '\0';
+	for (int i = 0; i < n; i++) {
+		list[i] = strs;
+		strs += strlen(strs) + 1;
+	}
+	return list;
+}
+
+void arena_free(Arena *a)
+{
+	for (ArenaBlock *b = a->head, *next; b; b = next) {
+		next = b->next;
+		free(b);
+	}
+	a->head = NULL;
+	a->used = 0;
+	a->size = 0;
+}
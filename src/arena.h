@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+
+typedef struct ArenaBlock ArenaBlock;
+
+/* bump allocator for data that lives exactly as long as its owner, released in one go */
+typedef struct Arena {
+	ArenaBlock *head;
+	size_t used;	/* bytes handed out */
+	size_t size;	/* bytes held in blocks */
+} Arena;
+
+void *arena_alloc(Arena *a, size_t n);
+char *arena_strdup(Arena *a, const char *s);
+char *arena_strndup(Arena *a, const char *s, size_t n);
+void arena_free(Arena *a);
+char **strlist_pack(const char *data, size_t len, int max, int *count);
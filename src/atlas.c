@@ -0,0 +1,368 @@
+/*
+ * Glyph atlas: every glyph is rasterised once with FreeType and uploaded into an XRender
+ * glyph set, upright and/or rotated 90 degrees clockwise (rotated in software, so the font
+ * matrix is never involved). Each font of the fallback chain gets its own pair of glyph sets,
+ * and text is drawn with one XRenderCompositeText32 per colour whatever fonts it spans.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <X11/Xlib.h>
+#include <X11/Xft/Xft.h>
+#include <X11/extensions/Xrender.h>
+
+#include "atlas.h"
+#include "fonts.h"
+
+#define MAX_PENS 16
+
+enum { UPRIGHT = 0, ROTATED = 1 };
+
+/* per font of the fallback chain, built the first time one of its glyphs is drawn */
+typedef struct Face {
+	XftFont *font;
+	GlyphSet sets[2];
+
+	/* indexed by glyph id: bit per orientation uploaded, advance in pixels */
+	unsigned char *loaded;
+	short *advance;
+	unsigned int nglyphs;
+} Face;
+
+struct Atlas {
+	Display *dpy;
+	XRenderPictFormat *a8;
+	Face faces[MAX_FONTS];
+
+	/* uploads are queued and sent in one AddGlyphs request per glyph set */
+	GlyphSet pend_set;
+	Glyph *pend_ids;
+	XGlyphInfo *pend_info;
+	int npend;
+	int pend_cap;
+	char *pend_data;
+	size_t data_len;
+	size_t data_cap;
+	size_t uploaded;	/* bitmap bytes sent to the server, for --mem-report */
+
+	/* solid fill source pictures, one per colour in use */
+	struct {
+		XRenderColor colour;
+		Picture pict;
+	} pens[MAX_PENS];
+	int npens;
+};
+
+Atlas *atlas_new(Display *dpy)
+{
+	Atlas *a = calloc(1, sizeof *a);
+	a->dpy = dpy;
+	a->a8 = XRenderFindStandardFormat(dpy, PictStandardA8);
+	if (!a->a8) {
+		free(a);
+		return NULL;
+	}
+	return a;
+}
+
+void atlas_free(Atlas *a)
+{
+	if (!a) {
+		return;
+	}
+	for (int i = 0; i < MAX_FONTS; i++) {
+		Face *f = &a->faces[i];
+		if (!f->font) {
+			continue;
+		}
+		XRenderFreeGlyphSet(a->dpy, f->sets[UPRIGHT]);
+		XRenderFreeGlyphSet(a->dpy, f->sets[ROTATED]);
+		free(f->loaded);
+		free(f->advance);
+	}
+	for (int i = 0; i < a->npens; i++) {
+		XRenderFreePicture(a->dpy, a->pens[i].pict);
+	}
+	free(a->pend_ids);
+	free(a->pend_info);
+	free(a->pend_data);
+	free(a);
+}
+
+/* *glyphs is bitmap data held in the server's glyph sets, *tables our per-face arrays */
+void atlas_memory(const Atlas *a, size_t *glyphs, size_t *tables)
+{
+	*glyphs = a ? a->uploaded : 0;
+	*tables = 0;
+	for (int i = 0; a && i < MAX_FONTS; i++) {
+		const Face *f = &a->faces[i];
+		if (f->font) {
+			*tables += (f->nglyphs + 1) * (sizeof *f->loaded + sizeof *f->advance);
+		}
+	}
+	if (a) {
+		*tables += a->data_cap + a->pend_cap * (sizeof *a->pend_ids + sizeof *a->pend_info);
+	}
+}
+
+static Face *face_for(Atlas *a, int idx)
+{
+	Face *f = &a->faces[idx];
+	if (f->font) {
+		return f;
+	}
+	XftFont *font = fonts_get(idx);
+	FT_Face ft = XftLockFace(font);
+	f->nglyphs = ft ? ft->num_glyphs : 0;
+	XftUnlockFace(font);
+
+	f->font = font;
+	f->loaded = calloc(f->nglyphs + 1, sizeof *f->loaded);
+	f->advance = calloc(f->nglyphs + 1, sizeof *f->advance);
+	f->sets[UPRIGHT] = XRenderCreateGlyphSet(a->dpy, a->a8);
+	f->sets[ROTATED] = XRenderCreateGlyphSet(a->dpy, a->a8);
+	return f;
+}
+
+static unsigned char *reserve(Atlas *a, size_t len)
+{
+	if (a->data_len + len > a->data_cap) {
+		size_t cap = a->data_cap ? a->data_cap : 4096;
+		while (cap < a->data_len + len) {
+			cap *= 2;
+		}
+		a->pend_data = realloc(a->pend_data, cap);
+		a->data_cap = cap;
+	}
+	unsigned char *p = (unsigned char *)a->pend_data + a->data_len;
+	a->data_len += len;
+	return p;
+}
+
+static int bitmap_alpha(const FT_Bitmap *bm, int x, int y)
+{
+	const unsigned char *row = bm->buffer + y * bm->pitch;
+	if (bm->pixel_mode == FT_PIXEL_MODE_MONO) {
+		return (row[x >> 3] & (0x80 >> (x & 7))) ? 0xff : 0;
+	}
+	return row[x];
+}
+
+static void flush_uploads(Atlas *a)
+{
+	if (a->npend) {
+		XRenderAddGlyphs(a->dpy, a->pend_set, a->pend_ids, a->pend_info, a->npend,
+				a->pend_data, a->data_len);
+	}
+	a->npend = 0;
+	a->data_len = 0;
+}
+
+/* rasterise glyph gi and queue it for upload, rows are padded to 4 bytes for A8 */
+static void load_glyph(Atlas *a, Face *f, unsigned int gi, int rot)
+{
+	if (f->loaded[gi] & (1 << rot)) {
+		return;
+	}
+	f->loaded[gi] |= 1 << rot;
+	if (a->npend && a->pend_set != f->sets[rot]) {
+		flush_uploads(a);
+	}
+	a->pend_set = f->sets[rot];
+
+	XGlyphInfo info = {0};
+	int w = 0, h = 0;
+	const FT_Bitmap *bm = NULL;
+	FT_Face face = XftLockFace(f->font);
+
+	if (face && !FT_Load_Glyph(face, gi, FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL)) {
+		FT_GlyphSlot slot = face->glyph;
+		f->advance[gi] = (slot->advance.x + 32) >> 6;
+		if (slot->bitmap.pixel_mode == FT_PIXEL_MODE_GRAY ||
+			slot->bitmap.pixel_mode == FT_PIXEL_MODE_MONO) {
+			bm = &slot->bitmap;
+			w = bm->width;
+			h = bm->rows;
+		}
+
+		int left = slot->bitmap_left;
+		int top = slot->bitmap_top;
+		if (rot == ROTATED) {
+			/* (dx, dy) -> (-dy, dx): the box [L, L+W] x [-T, -T+H] becomes [T-H, T] x [L, L+W] */
+			info.width = h;
+			info.height = w;
+			info.x = h - top;
+			info.y = -left;
+			info.yOff = f->advance[gi];
+		}
+		else {
+			info.width = w;
+			info.height = h;
+			info.x = -left;
+			info.y = top;
+			info.xOff = f->advance[gi];
+		}
+	}
+
+	int stride = (info.width + 3) & ~3;
+	a->uploaded += (size_t)stride * info.height;
+	unsigned char *dst = reserve(a, (size_t)stride * info.height);
+	memset(dst, 0, (size_t)stride * info.height);
+	for (int y = 0; bm && y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			int v = bitmap_alpha(bm, x, y);
+			if (rot == ROTATED) {
+				dst[x * stride + (h - 1 - y)] = v;
+			}
+			else {
+				dst[y * stride + x] = v;
+			}
+		}
+	}
+
+	XftUnlockFace(f->font);
+
+	if (a->npend == a->pend_cap) {
+		a->pend_cap = a->pend_cap ? a->pend_cap * 2 : 64;
+		a->pend_ids = realloc(a->pend_ids, a->pend_cap * sizeof *a->pend_ids);
+		a->pend_info = realloc(a->pend_info, a->pend_cap * sizeof *a->pend_info);
+	}
+	a->pend_ids[a->npend] = gi;
+	a->pend_info[a->npend] = info;
+	a->npend++;
+}
+
+/* append the glyphs of s to ids[*n] and their faces to fids[*n], loading any not seen before */
+static void shape(Atlas *a, const char *s, int rot,
+		unsigned int **ids, unsigned char **fids, int *n, int *cap)
+{
+	int len = strlen(s);
+
+	while (len > 0) {
+		FcChar32 ucs4;
+		int used = FcUtf8ToUcs4((const FcChar8 *)s, &ucs4, len);
+		if (used <= 0) {
+			break;
+		}
+		s += used;
+		len -= used;
+
+		int fi = fonts_index(ucs4);
+		Face *f = face_for(a, fi);
+		unsigned int gi = XftCharIndex(a->dpy, f->font, ucs4);
+		if (gi >= f->nglyphs) {
+			gi = 0;
+		}
+		load_glyph(a, f, gi, rot);
+
+		if (*n == *cap) {
+			*cap = *cap ? *cap * 2 : 64;
+			*ids = realloc(*ids, *cap * sizeof **ids);
+			*fids = realloc(*fids, *cap * sizeof **fids);
+		}
+		(*ids)[*n] = gi;
+		(*fids)[*n] = fi;
+		(*n)++;
+	}
+}
+
+int atlas_advance(Atlas *a, const char *s, int rotated)
+{
+	unsigned int *ids = NULL;
+	unsigned char *fids = NULL;
+	int n = 0, cap = 0;
+	shape(a, s, rotated ? ROTATED : UPRIGHT, &ids, &fids, &n, &cap);
+	flush_uploads(a);
+
+	int adv = 0;
+	for (int i = 0; i < n; i++) {
+		adv += a->faces[fids[i]].advance[ids[i]];
+	}
+	free(ids);
+	free(fids);
+	return adv;
+}
+
+static Picture pen(Atlas *a, const XftColor *col)
+{
+	for (int i = 0; i < a->npens; i++) {
+		if (!memcmp(&a->pens[i].colour, &col->color, sizeof col->color)) {
+			return a->pens[i].pict;
+		}
+	}
+	if (a->npens == MAX_PENS) {
+		/* recycle the oldest, colours rarely change at runtime */
+		XRenderFreePicture(a->dpy, a->pens[0].pict);
+		memmove(&a->pens[0], &a->pens[1], (MAX_PENS - 1) * sizeof a->pens[0]);
+		a->npens--;
+	}
+	a->pens[a->npens].colour = col->color;
+	a->pens[a->npens].pict = XRenderCreateSolidFill(a->dpy, &col->color);
+	return a->pens[a->npens++].pict;
+}
+
+void atlas_draw(Atlas *a, Picture dst, const XftColor *col, int rotated,
+		const AtlasRun *runs, int n)
+{
+	int rot = rotated ? ROTATED : UPRIGHT;
+	unsigned int *ids = NULL;
+	unsigned char *fids = NULL;
+	int cap = 0;
+	int *starts = malloc((n + 1) * sizeof *starts);
+
+	int total = 0;
+	for (int i = 0; i < n; i++) {
+		starts[i] = total;
+		shape(a, runs[i].text, rot, &ids, &fids, &total, &cap);
+	}
+	starts[n] = total;
+	flush_uploads(a);
+
+	/*
+	 * one element per same-font span; offsets are relative to where the previous element
+	 * left the pen, so spans after the first in a run continue from there
+	 */
+	XGlyphElt32 *elts = malloc((total ? total : 1) * sizeof *elts);
+	int penx = 0, peny = 0, nelts = 0;
+	for (int i = 0; i < n; i++) {
+		for (int g = starts[i]; g < starts[i + 1];) {
+			Face *f = &a->faces[fids[g]];
+			int end = g, adv = 0;
+			while (end < starts[i + 1] && fids[end] == fids[g]) {
+				adv += f->advance[ids[end]];
+				end++;
+			}
+
+			elts[nelts].glyphset = f->sets[rot];
+			elts[nelts].chars = ids + g;
+			elts[nelts].nchars = end - g;
+			if (g == starts[i]) {
+				elts[nelts].xOff = runs[i].x - penx;
+				elts[nelts].yOff = runs[i].y - peny;
+				penx = runs[i].x;
+				peny = runs[i].y;
+			}
+			else {
+				elts[nelts].xOff = 0;
+				elts[nelts].yOff = 0;
+			}
+			nelts++;
+
+			penx += rot == UPRIGHT ? adv : 0;
+			peny += rot == ROTATED ? adv : 0;
+			g = end;
+		}
+	}
+
+	if (nelts) {
+		XRenderCompositeText32(a->dpy, PictOpOver, pen(a, col), dst, a->a8, 0, 0, 0, 0,
+				elts, nelts);
+	}
+	free(elts);
+	free(starts);
+	free(ids);
+	free(fids);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <X11/Xlib.h>
+#include <X11/Xft/Xft.h>
+#include <X11/extensions/Xrender.h>
+
+typedef struct Atlas Atlas;
+
+/* a string placed with its pen origin at x, y */
+typedef struct AtlasRun {
+	int x;
+	int y;
+	const char *text;
+} AtlasRun;
+
+Atlas *atlas_new(Display *dpy);
+void atlas_free(Atlas *a);
+int atlas_advance(Atlas *a, const char *s, int rotated);
+void atlas_memory(const Atlas *a, size_t *glyphs, size_t *tables);
+void atlas_draw(Atlas *a, Picture dst, const XftColor *col, int rotated,
+		const AtlasRun *runs, int n);
@@ -0,0 +1,182 @@
+/*
+ * XCB backend for the requests on the event and render path. Requests are issued as
+ * cookies first and their replies collected afterwards, so independent queries share a
+ * single round-trip. Xft/XRender keep drawing through the Xlib side of the same connection.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+#include <xcb/xproto.h>
+
+#include "defs.h"
+#include "backend_xcb.h"
+
+static xcb_connection_t *conn;
+static xcb_generic_event_t *peeked;
+
+void backend_init(Display *dpy)
+{
+	conn = XGetXCBConnection(dpy);
+	XSetEventQueueOwner(dpy, XCBOwnsEventQueue);
+}
+
+void backend_intern_atoms(char **names, int count, Atom *atoms)
+{
+	xcb_intern_atom_cookie_t *cookies = malloc(count * sizeof *cookies);
+	for (int i = 0; i < count; i++) {
+		cookies[i] = xcb_intern_atom(conn, 0, strlen(names[i]), names[i]);
+	}
+	for (int i = 0; i < count; i++) {
+		xcb_intern_atom_reply_t *r = xcb_intern_atom_reply(conn, cookies[i], NULL);
+		atoms[i] = r ? r->atom : None;
+		free(r);
+	}
+	free(cookies);
+}
+
+Window backend_create_window(Window parent, int x, int y, int w, int h, int bw,
+		unsigned long bg, unsigned long border, long event_mask, Atom wm_type, Atom dock)
+{
+	xcb_window_t win = xcb_generate_id(conn);
+	uint32_t values[] = {bg, border, (uint32_t)event_mask};
+
+	xcb_create_window(conn, XCB_COPY_FROM_PARENT, win, parent, x, y, w, h, bw,
+			XCB_WINDOW_CLASS_INPUT_OUTPUT, XCB_COPY_FROM_PARENT,
+			XCB_CW_BACK_PIXEL | XCB_CW_BORDER_PIXEL | XCB_CW_EVENT_MASK, values);
+
+	static const char class[] = "sxbar\0sxbar";
+	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, win, XCB_ATOM_WM_NAME,
+			XCB_ATOM_STRING, 8, 5, "sxbar");
+	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, win, XCB_ATOM_WM_CLASS,
+			XCB_ATOM_STRING, 8, sizeof class, class);
+	uint32_t type = dock;
+	xcb_change_property(conn, XCB_PROP_MODE_REPLACE, win, wm_type,
+			XCB_ATOM_ATOM, 32, 1, &type);
+	return win;
+}
+
+void backend_read_workspaces(Window root, Atom current_atom, Atom names_atom, Atom utf8,
+		int *current, char ***names, int *count)
+{
+	xcb_get_property_cookie_t cc = {0}, nc = {0};
+
+	/* both requests go out before either reply is awaited */
+	if (current) {
+		cc = xcb_get_property(conn, 0, root, current_atom, XCB_ATOM_CARDINAL, 0, 1);
+	}
+	if (names) {
+		nc = xcb_get_property(conn, 0, root, names_atom, utf8, 0, ~0U / 4);
+	}
+
+	if (current) {
+		xcb_get_property_reply_t *r = xcb_get_property_reply(conn, cc, NULL);
+		*current = -1;
+		if (r && r->format == 32 && xcb_get_property_value_length(r) >= 4) {
+			*current = *(uint32_t *)xcb_get_property_value(r);
+		}
+		free(r);
+	}
+
+	if (names) {
+		xcb_get_property_reply_t *r = xcb_get_property_reply(conn, nc, NULL);
+		*names = NULL;
+		*count = 0;
+		if (r && r->format == 8) {
+			*names = strlist_pack(xcb_get_property_value(r), xcb_get_property_value_length(r),
+					MAX_MONITORS, count);
+		}
+		free(r);
+	}
+}
+
+/*
+ * the root window's size as the server has it now; Xlib's cached screen size is only
+ * refreshed by XRRUpdateConfiguration(), which never sees the events xcb reads
+ */
+int backend_root_size(Window root, int *w, int *h)
+{
+	xcb_get_geometry_cookie_t c = xcb_get_geometry(conn, root);
+	xcb_get_geometry_reply_t *r = xcb_get_geometry_reply(conn, c, NULL);
+	if (!r) {
+		return -1;
+	}
+	*w = r->width;
+	*h = r->height;
+	free(r);
+	return 0;
+}
+
+/* translate the few core events sxbar handles, everything else becomes type 0 */
+static void to_xevent(xcb_generic_event_t *ev, XEvent *xev)
+{
+	memset(xev, 0, sizeof *xev);
+	xev->xany.send_event = (ev->response_type & 0x80) != 0;
+
+	switch (ev->response_type & ~0x80) {
+		case XCB_EXPOSE: {
+			xcb_expose_event_t *e = (xcb_expose_event_t *)ev;
+			xev->type = Expose;
+			xev->xexpose.window = e->window;
+			xev->xexpose.x = e->x;
+			xev->xexpose.y = e->y;
+			xev->xexpose.width = e->width;
+			xev->xexpose.height = e->height;
+			xev->xexpose.count = e->count;
+			break;
+		}
+		case XCB_PROPERTY_NOTIFY: {
+			xcb_property_notify_event_t *e = (xcb_property_notify_event_t *)ev;
+			xev->type = PropertyNotify;
+			xev->xproperty.window = e->window;
+			xev->xproperty.atom = e->atom;
+			xev->xproperty.time = e->time;
+			xev->xproperty.state = e->state;
+			break;
+		}
+		case XCB_BUTTON_PRESS: {
+			xcb_button_press_event_t *e = (xcb_button_press_event_t *)ev;
+			xev->type = ButtonPress;
+			xev->xbutton.window = e->event;
+			xev->xbutton.x = e->event_x;
+			xev->xbutton.y = e->event_y;
+			xev->xbutton.button = e->detail;
+			xev->xbutton.state = e->state;
+			xev->xbutton.time = e->time;
+			break;
+		}
+		default:
+			/* extension events (RandR) keep their raw type */
+			xev->type = ev->response_type & ~0x80;
+			break;
+	}
+}
+
+int backend_next_event(XEvent *xev)
+{
+	xcb_generic_event_t *ev = peeked ? peeked : xcb_poll_for_event(conn);
+	peeked = NULL;
+	if (!ev) {
+		return 0;
+	}
+	to_xevent(ev, xev);
+	free(ev);
+	return 1;
+}
+
+/* events read off the socket while waiting for replies, poll() won't see those */
+int backend_events_queued(void)
+{
+	if (!peeked) {
+		peeked = xcb_poll_for_queued_event(conn);
+	}
+	return peeked != NULL;
+}
+
+void backend_flush(void)
+{
+	xcb_flush(conn);
+}
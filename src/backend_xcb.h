@@ -0,0 +1,14 @@
+#pragma once
+
+#include <X11/Xlib.h>
+
+void backend_init(Display *dpy);
+void backend_intern_atoms(char **names, int count, Atom *atoms);
+Window backend_create_window(Window parent, int x, int y, int w, int h, int bw,
+		unsigned long bg, unsigned long border, long event_mask, Atom wm_type, Atom dock);
+void backend_read_workspaces(Window root, Atom current_atom, Atom names_atom, Atom utf8,
+		int *current, char ***names, int *count);
+int backend_root_size(Window root, int *w, int *h);
+int backend_next_event(XEvent *xev);
+int backend_events_queued(void);
+void backend_flush(void);
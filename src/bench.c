@@ -0,0 +1,220 @@
+#define _POSIX_C_SOURCE 200809L
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/Xinerama.h>
+
+#include "defs.h"
+#include "bench.h"
+#include "modules.h"
+
+extern Display *dpy;
+extern int scr;
+extern Window root;
+extern GC gc;
+extern Config config;
+extern XineramaScreenInfo *monitors;
+extern int n_monitors;
+extern int ws_current;
+extern char **ws_names;
+extern int ws_name_count;
+
+void alloc_colours(void);
+void bar_geometry(const XineramaScreenInfo *m, int *x, int *y, int *w, int *h);
+void draw_bar_into(Drawable draw, int monitor_index);
+void load_config(void);
+void load_fonts(void);
+void open_display(void);
+XineramaScreenInfo *query_monitors(int *count);
+
+static const char *synthetic_names[] = {
+	"clock", "date", "battery", "volume", "cpu", "mem",
+};
+
+static double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* bytes written by the process so far, which is X protocol traffic while benchmarking */
+static long long bytes_written(void)
+{
+	FILE *fp = fopen("/proc/self/io", "r");
+	if (!fp) {
+		return -1;
+	}
+	char line[128];
+	long long wchar = -1;
+	while (fgets(line, sizeof line, fp)) {
+		if (!strncmp(line, "wchar:", 6)) {
+			wchar = atoll(line + 6);
+			break;
+		}
+	}
+	fclose(fp);
+	return wchar;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static double percentile(const double *sorted, int n, double p)
+{
+	int idx = (int)(p / 100.0 * (n - 1) + 0.5);
+	return sorted[idx];
+}
+
+/* fake module output and workspace state so every frame exercises the layout code */
+static void synthesize_frame(int frame)
+{
+	for (int i = 0; i < config.module_count; i++) {
+		Module *m = &config.modules[i];
+		char buf[128];
+		snprintf(buf, sizeof buf, "%s %d%%", m->name ? m->name : "module",
+				(frame * 7 + i * 13) % 100);
+		module_set_output(m, buf);
+	}
+
+	int count = config.ws_label_count > 0 ? config.ws_label_count : ws_name_count;
+	ws_current = count > 0 ? frame % count : -1;
+}
+
+static int shift_of(unsigned long mask)
+{
+	return mask ? ffs((int)mask) - 1 : 0;
+}
+
+static int dump_ppm(Pixmap pm, int w, int h, const char *path)
+{
+	XImage *img = XGetImage(dpy, pm, 0, 0, w, h, AllPlanes, ZPixmap);
+	if (!img) {
+		warnx("could not read back frame");
+		return -1;
+	}
+	FILE *fp = fopen(path, "wb");
+	if (!fp) {
+		warn("%s", path);
+		XDestroyImage(img);
+		return -1;
+	}
+
+	int rs = shift_of(img->red_mask);
+	int gs = shift_of(img->green_mask);
+	int bs = shift_of(img->blue_mask);
+	unsigned long rm = img->red_mask >> rs;
+	unsigned long gm = img->green_mask >> gs;
+	unsigned long bm = img->blue_mask >> bs;
+
+	fprintf(fp, "P6\n%d %d\n255\n", w, h);
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			unsigned long px = XGetPixel(img, x, y);
+			unsigned char rgb[3] = {
+				rm ? ((px >> rs) & rm) * 255 / rm : 0,
+				gm ? ((px >> gs) & gm) * 255 / gm : 0,
+				bm ? ((px >> bs) & bm) * 255 / bm : 0,
+			};
+			fwrite(rgb, 1, sizeof rgb, fp);
+		}
+	}
+	fclose(fp);
+	XDestroyImage(img);
+	return 0;
+}
+
+int bench_render(int frames, const char *dump_path)
+{
+	open_display();
+	load_config();
+
+	/* modules never run here, give the bar something to lay out */
+	if (config.module_count == 0) {
+		int n = sizeof synthetic_names / sizeof *synthetic_names;
+		config.modules = calloc(n, sizeof(Module));
+		config.module_count = config.max_modules = n;
+		for (int i = 0; i < n; i++) {
+			config.modules[i].name = arena_strdup(&config.arena, synthetic_names[i]);
+		}
+	}
+	for (int i = 0; i < config.module_count; i++) {
+		config.modules[i].enabled = True;
+	}
+	if (!config.ws_labels || config.ws_label_count == 0) {
+		static const char digits[] = "1\0" "2\0" "3\0" "4\0" "5\0" "6\0" "7\0" "8\0" "9";
+		ws_names = strlist_pack(digits, sizeof digits, MAX_MONITORS, &ws_name_count);
+	}
+
+	/* offscreen only: a pixmap for the first monitor, no window is mapped */
+	monitors = query_monitors(&n_monitors);
+	int x, y, w, h;
+	bar_geometry(&monitors[0], &x, &y, &w, &h);
+	Pixmap pm = XCreatePixmap(dpy, root, w, h, DefaultDepth(dpy, scr));
+	gc = XCreateGC(dpy, pm, 0, NULL);
+	load_fonts();
+	alloc_colours();
+
+	/* warm up the glyph caches before measuring */
+	synthesize_frame(0);
+	draw_bar_into(pm, 0);
+	XSync(dpy, False);
+
+	double *times = malloc(frames * sizeof *times);
+	unsigned long requests = 0;
+	long long bytes0 = bytes_written();
+
+	for (int i = 0; i < frames; i++) {
+		synthesize_frame(i + 1);
+		unsigned long req0 = NextRequest(dpy);
+		double t0 = now_us();
+		draw_bar_into(pm, 0);
+		XSync(dpy, False);
+		times[i] = now_us() - t0;
+		/* minus the GetInputFocus round-trip issued by XSync */
+		requests += NextRequest(dpy) - req0 - 1;
+	}
+
+	long long bytes1 = bytes_written();
+	double total = 0;
+	for (int i = 0; i < frames; i++) {
+		total += times[i];
+	}
+	qsort(times, frames, sizeof *times, cmp_double);
+
+	printf("frames        %d (%dx%d, %s)\n", frames, w, h,
+			IS_VERTICAL(config.bar_position) ? "vertical" : "horizontal");
+	printf("mean          %.1f us\n", total / frames);
+	printf("p50           %.1f us\n", percentile(times, frames, 50));
+	printf("p90           %.1f us\n", percentile(times, frames, 90));
+	printf("p99           %.1f us\n", percentile(times, frames, 99));
+	printf("max           %.1f us\n", times[frames - 1]);
+	printf("requests      %.1f / frame\n", (double)requests / frames);
+	if (bytes0 >= 0 && bytes1 >= 0) {
+		printf("bytes sent    %.1f / frame\n", (double)(bytes1 - bytes0) / frames);
+	}
+	else {
+		printf("bytes sent    n/a\n");
+	}
+	free(times);
+
+	int ret = 0;
+	if (dump_path) {
+		ret = dump_ppm(pm, w, h, dump_path) < 0;
+	}
+
+	XFreePixmap(dpy, pm);
+	XFreeGC(dpy, gc);
+	XCloseDisplay(dpy);
+	return ret;
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+int bench_render(int frames, const char *dump_path);
@@ -0,0 +1,471 @@
+/*
+ * Client-side rendering (make RENDER=client). A horizontal bar is rasterised into a 32-bit
+ * buffer: fills are plain stores, text is FreeType coverage from a glyph bitmap cache blended
+ * four pixels at a time with SSE2. The frame is compared against a shadow of what the
+ * target drawable already holds and only the damaged rectangle is uploaded, through MIT-SHM
+ * when the server is local and XPutImage otherwise.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xft/Xft.h>
+#include <X11/extensions/XShm.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "canvas.h"
+#include "fonts.h"
+
+/* coverage of one glyph at its pen offset; key is font index << 16 | glyph index, plus one */
+typedef struct GlyphBits {
+	unsigned int key;
+	short left;
+	short top;
+	unsigned short w;
+	unsigned short h;
+	short advance;
+	unsigned char *alpha;
+} GlyphBits;
+
+struct Canvas {
+	Display *dpy;
+	XImage *img;
+	XShmSegmentInfo shm;
+	int use_shm;
+	unsigned long put_serial;	/* the server may still read the segment until this is done */
+
+	uint32_t *px;
+	int stride;			/* in pixels */
+	int w;
+	int h;
+	int cx0, cy0, cx1, cy1;	/* clip rectangle, exclusive right/bottom */
+
+	/* what target holds, so unchanged pixels are never sent again */
+	uint32_t *shadow;
+	Drawable target;
+};
+
+/* open-addressed, shared by every canvas; dropped with the fonts */
+static GlyphBits *glyphs;
+static unsigned int glyph_cap;
+static unsigned int glyph_count;
+static size_t glyph_bytes;
+
+static int shm_failed;
+
+int canvas_usable(Display *dpy, int scr)
+{
+	Visual *v = DefaultVisual(dpy, scr);
+	int depth = DefaultDepth(dpy, scr);
+	if (v->class != TrueColor || (depth != 24 && depth != 32) || v->red_mask != 0xff0000 ||
+		v->green_mask != 0xff00 || v->blue_mask != 0xff) {
+		return 0;
+	}
+	int n, bpp = 0;
+	XPixmapFormatValues *fmts = XListPixmapFormats(dpy, &n);
+	for (int i = 0; fmts && i < n; i++) {
+		if (fmts[i].depth == depth) {
+			bpp = fmts[i].bits_per_pixel;
+		}
+	}
+	if (fmts) {
+		XFree(fmts);
+	}
+	return bpp == 32;
+}
+
+static int shm_error(Display *dpy, XErrorEvent *ee)
+{
+	(void)dpy;
+	(void)ee;
+	shm_failed = 1;
+	return 0;
+}
+
+/* a shared segment the server maps too; fails on remote displays */
+static XImage *create_shm_image(Canvas *c, Visual *v, int depth, int w, int h)
+{
+	XImage *img = XShmCreateImage(c->dpy, v, depth, ZPixmap, NULL, &c->shm, w, h);
+	if (!img) {
+		return NULL;
+	}
+	c->shm.shmid = shmget(IPC_PRIVATE, (size_t)img->bytes_per_line * h, IPC_CREAT | 0600);
+	if (c->shm.shmid < 0) {
+		XDestroyImage(img);
+		return NULL;
+	}
+	c->shm.shmaddr = img->data = shmat(c->shm.shmid, NULL, 0);
+	c->shm.readOnly = False;
+	if (c->shm.shmaddr == (char *)-1) {
+		shmctl(c->shm.shmid, IPC_RMID, NULL);
+		img->data = NULL;
+		XDestroyImage(img);
+		return NULL;
+	}
+
+	shm_failed = 0;
+	int (*prev)(Display *, XErrorEvent *) = XSetErrorHandler(shm_error);
+	XShmAttach(c->dpy, &c->shm);
+	XSync(c->dpy, False);
+	XSetErrorHandler(prev);
+	/* removed now, the segment lives on until both sides detach */
+	shmctl(c->shm.shmid, IPC_RMID, NULL);
+	if (shm_failed) {
+		shmdt(c->shm.shmaddr);
+		img->data = NULL;
+		XDestroyImage(img);
+		return NULL;
+	}
+	return img;
+}
+
+Canvas *canvas_new(Display *dpy, int scr, int w, int h)
+{
+	Canvas *c = calloc(1, sizeof *c);
+	c->dpy = dpy;
+	Visual *v = DefaultVisual(dpy, scr);
+	int depth = DefaultDepth(dpy, scr);
+
+	if (XShmQueryExtension(dpy) && (c->img = create_shm_image(c, v, depth, w, h))) {
+		c->use_shm = 1;
+	}
+	else {
+		char *data = malloc((size_t)w * h * 4);
+		c->img = XCreateImage(dpy, v, depth, ZPixmap, 0, data, w, h, 32, w * 4);
+		if (!c->img) {
+			free(data);
+			free(c);
+			return NULL;
+		}
+		/* pixels are written as native words, Xlib swaps them if the server differs */
+		int one = 1;
+		c->img->byte_order = *(char *)&one ? LSBFirst : MSBFirst;
+	}
+
+	c->px = (uint32_t *)c->img->data;
+	c->stride = c->img->bytes_per_line / 4;
+	c->w = w;
+	c->h = h;
+	c->shadow = malloc((size_t)w * h * sizeof *c->shadow);
+	c->target = None;
+	canvas_clip(c, 0, 0, w, h);
+	return c;
+}
+
+void canvas_free(Canvas *c)
+{
+	if (!c) {
+		return;
+	}
+	if (c->use_shm) {
+		XShmDetach(c->dpy, &c->shm);
+		XSync(c->dpy, False);
+		shmdt(c->shm.shmaddr);
+		c->img->data = NULL;
+	}
+	XDestroyImage(c->img);
+	free(c->shadow);
+	free(c);
+}
+
+int canvas_fits(const Canvas *c, int w, int h)
+{
+	return c && c->w == w && c->h == h;
+}
+
+/* call before drawing: the previous upload must have been read out of the segment */
+void canvas_begin(Canvas *c)
+{
+	if (c->put_serial && LastKnownRequestProcessed(c->dpy) < c->put_serial) {
+		XSync(c->dpy, False);
+	}
+	c->put_serial = 0;
+	canvas_clip(c, 0, 0, c->w, c->h);
+}
+
+void canvas_clip(Canvas *c, int x, int y, int w, int h)
+{
+	c->cx0 = x < 0 ? 0 : x;
+	c->cy0 = y < 0 ? 0 : y;
+	c->cx1 = x + w > c->w ? c->w : x + w;
+	c->cy1 = y + h > c->h ? c->h : y + h;
+}
+
+void canvas_fill(Canvas *c, unsigned long pixel, int x, int y, int w, int h)
+{
+	int x0 = x < c->cx0 ? c->cx0 : x;
+	int y0 = y < c->cy0 ? c->cy0 : y;
+	int x1 = x + w > c->cx1 ? c->cx1 : x + w;
+	int y1 = y + h > c->cy1 ? c->cy1 : y + h;
+	for (int row = y0; row < y1; row++) {
+		uint32_t *p = c->px + (size_t)row * c->stride;
+		for (int col = x0; col < x1; col++) {
+			p[col] = pixel;
+		}
+	}
+}
+
+/* dst = src * a + dst * (1 - a) per channel, rounded like a divide by 255 */
+static void blend_span(uint32_t *dst, const unsigned char *a, int n, uint32_t src)
+{
+	int i = 0;
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i full = _mm_set1_epi16(255);
+	const __m128i half = _mm_set1_epi16(128);
+	const __m128i s = _mm_unpacklo_epi8(_mm_set1_epi32(src), zero);
+
+	for (; i + 4 <= n; i += 4) {
+		uint32_t a4;
+		memcpy(&a4, a + i, 4);
+		if (!a4) {
+			continue;
+		}
+		/* every coverage byte spread over the four channels of its pixel */
+		__m128i av = _mm_cvtsi32_si128(a4);
+		av = _mm_unpacklo_epi8(av, av);
+		av = _mm_unpacklo_epi16(av, av);
+		__m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+
+		__m128i alo = _mm_unpacklo_epi8(av, zero);
+		__m128i ahi = _mm_unpackhi_epi8(av, zero);
+		__m128i tlo = _mm_add_epi16(_mm_mullo_epi16(s, alo),
+				_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(full, alo)));
+		__m128i thi = _mm_add_epi16(_mm_mullo_epi16(s, ahi),
+				_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(full, ahi)));
+		tlo = _mm_add_epi16(tlo, half);
+		thi = _mm_add_epi16(thi, half);
+		tlo = _mm_srli_epi16(_mm_add_epi16(tlo, _mm_srli_epi16(tlo, 8)), 8);
+		thi = _mm_srli_epi16(_mm_add_epi16(thi, _mm_srli_epi16(thi, 8)), 8);
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(tlo, thi));
+	}
+#endif
+	const uint32_t srb = src & 0x00ff00ff;
+	const uint32_t sag = (src >> 8) & 0x00ff00ff;
+	for (; i < n; i++) {
+		uint32_t k = a[i];
+		if (!k) {
+			continue;
+		}
+		if (k == 255) {
+			dst[i] = src;
+			continue;
+		}
+		/* two channels per word, each sum stays below 16 bits */
+		uint32_t d = dst[i];
+		uint32_t rb = srb * k + (d & 0x00ff00ff) * (255 - k) + 0x00800080;
+		uint32_t ag = sag * k + ((d >> 8) & 0x00ff00ff) * (255 - k) + 0x00800080;
+		rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+		ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+		dst[i] = rb | ag;
+	}
+}
+
+static int bitmap_alpha(const FT_Bitmap *bm, int x, int y)
+{
+	const unsigned char *row = bm->buffer + y * bm->pitch;
+	if (bm->pixel_mode == FT_PIXEL_MODE_MONO) {
+		return (row[x >> 3] & (0x80 >> (x & 7))) ? 0xff : 0;
+	}
+	return row[x];
+}
+
+static GlyphBits *glyph_slot(unsigned int key)
+{
+	unsigned int i = (key * 2654435761u) & (glyph_cap - 1);
+	while (glyphs[i].key && glyphs[i].key != key) {
+		i = (i + 1) & (glyph_cap - 1);
+	}
+	return &glyphs[i];
+}
+
+static void glyphs_grow(void)
+{
+	GlyphBits *old = glyphs;
+	unsigned int old_cap = glyph_cap;
+	glyph_cap = glyph_cap ? glyph_cap * 2 : 256;
+	glyphs = calloc(glyph_cap, sizeof *glyphs);
+	for (unsigned int i = 0; i < old_cap; i++) {
+		if (old[i].key) {
+			*glyph_slot(old[i].key) = old[i];
+		}
+	}
+	free(old);
+}
+
+/*
+ * the cached coverage of glyph gi of font fi, rasterised on first use. The pen moves by
+ * Xft's own advance so text fills exactly the width fonts_text_width() measured for it
+ */
+static const GlyphBits *glyph_get(Display *dpy, int fi, FT_UInt gi)
+{
+	unsigned int key = ((unsigned int)fi << 16 | gi) + 1;
+	if (glyph_cap) {
+		GlyphBits *g = glyph_slot(key);
+		if (g->key) {
+			return g;
+		}
+	}
+	if ((glyph_count + 1) * 4 > glyph_cap * 3) {
+		glyphs_grow();
+	}
+
+	GlyphBits *g = glyph_slot(key);
+	memset(g, 0, sizeof *g);
+	g->key = key;
+	glyph_count++;
+
+	XftFont *font = fonts_get(fi);
+	XGlyphInfo ext;
+	XftGlyphExtents(dpy, font, &gi, 1, &ext);
+	g->advance = ext.xOff;
+
+	FT_Face face = XftLockFace(font);
+	if (face && !FT_Load_Glyph(face, gi, FT_LOAD_RENDER | FT_LOAD_TARGET_NORMAL)) {
+		FT_GlyphSlot slot = face->glyph;
+		const FT_Bitmap *bm = &slot->bitmap;
+		g->left = slot->bitmap_left;
+		g->top = slot->bitmap_top;
+		if ((bm->pixel_mode == FT_PIXEL_MODE_GRAY || bm->pixel_mode == FT_PIXEL_MODE_MONO) &&
+			bm->width && bm->rows) {
+			g->w = bm->width;
+			g->h = bm->rows;
+			g->alpha = malloc((size_t)g->w * g->h);
+			for (int y = 0; y < g->h; y++) {
+				for (int x = 0; x < g->w; x++) {
+					g->alpha[y * g->w + x] = bitmap_alpha(bm, x, y);
+				}
+			}
+			glyph_bytes += (size_t)g->w * g->h;
+		}
+	}
+	XftUnlockFace(font);
+	return g;
+}
+
+static void draw_glyph(Canvas *c, const GlyphBits *g, int x, int y, uint32_t src)
+{
+	int gx = x + g->left, gy = y - g->top;
+	int x0 = gx < c->cx0 ? c->cx0 : gx;
+	int y0 = gy < c->cy0 ? c->cy0 : gy;
+	int x1 = gx + g->w > c->cx1 ? c->cx1 : gx + g->w;
+	int y1 = gy + g->h > c->cy1 ? c->cy1 : gy + g->h;
+	for (int row = y0; row < y1; row++) {
+		blend_span(c->px + (size_t)row * c->stride + x0,
+				g->alpha + (size_t)(row - gy) * g->w + (x0 - gx), x1 - x0, src);
+	}
+}
+
+/* pen origin at x, y like XftDrawStringUtf8, split into runs over the fallback fonts */
+void canvas_text(Canvas *c, const XftColor *col, int x, int y, const char *s)
+{
+	int len = strlen(s);
+	int idx;
+	const char *p = s;
+
+	for (int run; (run = fonts_next_run(&p, &len, &idx)) > 0;) {
+		XftFont *font = fonts_get(idx);
+		const FcChar8 *str = (const FcChar8 *)(p - run);
+		while (run > 0) {
+			FcChar32 cp;
+			int used = FcUtf8ToUcs4(str, &cp, run);
+			if (used <= 0) {
+				break;
+			}
+			str += used;
+			run -= used;
+
+			const GlyphBits *g = glyph_get(c->dpy, idx, XftCharIndex(c->dpy, font, cp));
+			if (g->alpha && x + g->left < c->cx1 && x + g->left + g->w > c->cx0) {
+				draw_glyph(c, g, x, y, col->pixel);
+			}
+			x += g->advance;
+		}
+	}
+}
+
+/*
+ * upload what differs from dst's last known contents; *damage gets the rectangle sent,
+ * empty when nothing changed. Returns true if anything was uploaded.
+ */
+int canvas_put(Canvas *c, Drawable dst, GC gc, XRectangle *damage)
+{
+	int x0 = c->w, y0 = c->h, x1 = -1, y1 = -1;
+
+	if (dst != c->target) {
+		x0 = y0 = 0;
+		x1 = c->w - 1;
+		y1 = c->h - 1;
+	}
+	else {
+		for (int row = 0; row < c->h; row++) {
+			const uint32_t *p = c->px + (size_t)row * c->stride;
+			const uint32_t *s = c->shadow + (size_t)row * c->w;
+			if (!memcmp(p, s, c->w * sizeof *p)) {
+				continue;
+			}
+			int l = 0, r = c->w - 1;
+			while (p[l] == s[l]) {
+				l++;
+			}
+			while (p[r] == s[r]) {
+				r--;
+			}
+			x0 = l < x0 ? l : x0;
+			x1 = r > x1 ? r : x1;
+			y0 = row < y0 ? row : y0;
+			y1 = row;
+		}
+	}
+
+	if (x1 < 0) {
+		*damage = (XRectangle){0, 0, 0, 0};
+		return 0;
+	}
+	*damage = (XRectangle){x0, y0, x1 - x0 + 1, y1 - y0 + 1};
+
+	if (c->use_shm) {
+		c->put_serial = NextRequest(c->dpy);
+		XShmPutImage(c->dpy, dst, gc, c->img, x0, y0, x0, y0, damage->width, damage->height, False);
+	}
+	else {
+		XPutImage(c->dpy, dst, gc, c->img, x0, y0, x0, y0, damage->width, damage->height);
+	}
+	for (int row = y0; row <= y1; row++) {
+		memcpy(c->shadow + (size_t)row * c->w + x0, c->px + (size_t)row * c->stride + x0,
+				damage->width * sizeof *c->px);
+	}
+	c->target = dst;
+	return 1;
+}
+
+size_t canvas_memory(const Canvas *c)
+{
+	return c ? (size_t)c->img->bytes_per_line * c->h + (size_t)c->w * c->h * sizeof *c->shadow : 0;
+}
+
+size_t canvas_glyph_memory(void)
+{
+	return glyph_bytes + glyph_cap * sizeof *glyphs;
+}
+
+void canvas_glyphs_free(void)
+{
+	for (unsigned int i = 0; i < glyph_cap; i++) {
+		free(glyphs[i].alpha);
+	}
+	free(glyphs);
+	glyphs = NULL;
+	glyph_cap = 0;
+	glyph_count = 0;
+	glyph_bytes = 0;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include <X11/Xlib.h>
+#include <X11/Xft/Xft.h>
+
+typedef struct Canvas Canvas;
+
+int canvas_usable(Display *dpy, int scr);
+Canvas *canvas_new(Display *dpy, int scr, int w, int h);
+void canvas_free(Canvas *c);
+int canvas_fits(const Canvas *c, int w, int h);
+void canvas_begin(Canvas *c);
+void canvas_clip(Canvas *c, int x, int y, int w, int h);
+void canvas_fill(Canvas *c, unsigned long pixel, int x, int y, int w, int h);
+void canvas_text(Canvas *c, const XftColor *col, int x, int y, const char *s);
+int canvas_put(Canvas *c, Drawable dst, GC gc, XRectangle *damage);
+size_t canvas_memory(const Canvas *c);
+size_t canvas_glyph_memory(void);
+void canvas_glyphs_free(void);
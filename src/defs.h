@@ -3,23 +3,93 @@
 #include <X11/Xlib.h>
 #include <time.h>
 
+#include "arena.h"
+
 #define SXBAR_VERSION	"sxbar ver. 1.0"
 #define SXBAR_AUTHOR	"(C) Abhinav Prasai 2025"
 #define SXBAR_LICINFO	"See LICENSE for more info"
 
 #define MAX_MONITORS 32
+#define MAX_MODULES 1024
 
 #define PATH_MAX 4096
 
+typedef enum {
+	MODULE_COMMAND = 0,
+	MODULE_WINDOW_TITLE = 1,	/* built in, follows the focused window's title */
+	MODULE_FILE = 2,		/* shows the contents of path, re-read when it is rewritten */
+	MODULE_STDIN = 3		/* a block of the status stream read in --stdin mode */
+} ModuleType;
+
+typedef enum {
+	SPAWN_SCHED_INHERIT = 0,
+	SPAWN_SCHED_OTHER = 1,
+	SPAWN_SCHED_BATCH = 2,
+	SPAWN_SCHED_IDLE = 3
+} SpawnSched;
+
+/* applied to a module's command in the child before exec; zeroed means inherit */
+typedef struct SpawnOpts {
+	int nice_set;
+	int nice;
+	SpawnSched sched;
+	char *cpus;		/* cpu list as taskset -c takes it, e.g. 0-3,6 */
+	char *cgroup;	/* cgroup v2 leaf, relative to our own cgroup unless absolute */
+} SpawnOpts;
+
 typedef struct Module {
+	ModuleType type;
 	char *name;
 	char *command;
+	char *path;
+	int wd;		/* inotify watch on the directory of path, 0 when not watched */
 	int enabled;
-	int refresh_interval;
-	time_t last_update;
-	char *cached_output;
+	int refresh_interval;	/* milliseconds, like every interval below */
+	long long last_update;	/* CLOCK_MONOTONIC milliseconds, 0 before the first run */
+
+	/* adaptive polling: after backoff unchanged runs the interval doubles up to max_interval */
+	int backoff;
+	int max_interval;	/* 0 for eight times refresh_interval */
+	int cur_interval;	/* interval in use, 0 until the first run */
+	int unchanged;
+	int changed;	/* output differs from what is on screen */
+	char *cached_output;	/* reused across updates, only grown when output gets longer */
+	size_t output_cap;
+
+	/* cached_output split at its markup, built by the bar on first draw after a change */
+	struct MarkupRun *runs;
+	int run_count;
+	int width;
+
+	/* horizontal bars: text wider than max_width is clipped, or scrolled with marquee */
+	int max_width;
+	int marquee;
+	Pixmap strip;	/* the full text, twice over when scrolling, drawn on first use */
+	int strip_w;	/* one copy of the text plus the gap before it repeats */
+	int scroll;
+	int slot_rx[MAX_MONITORS];	/* left edge of the slot on each bar, from its right edge */
+	int slot_w;		/* width the slot was last drawn with, valid once placed */
+	int placed;
+
+	/* bars showing the module: a bit per monitor index and/or the primary one, none for all */
+	unsigned int monitor_mask;
+	int on_primary;
+
+	/* run detached on a click or scroll over the slot, NULL for none */
+	char *on_click;
+	char *on_scroll_up;
+	char *on_scroll_down;
+
+	SpawnOpts spawn;	/* overrides the global spawn.* options field by field */
 } Module;
 
+/* a clickable area of a bar as last laid out: one workspace label or one module's slot */
+typedef struct Segment {
+	int x, y, w, h;
+	int workspace;	/* desktop index, -1 for a module */
+	int module;		/* index into config.modules, -1 for a workspace */
+} Segment;
+
 typedef enum {
 	WS_POS_LEFT = 0,
 	WS_POS_CENTER = 1,
@@ -33,6 +103,8 @@ typedef enum {
 	BAR_POS_RIGHT = 3
 } BarPosition;
 
+#define IS_VERTICAL(pos) ((pos) == BAR_POS_LEFT || (pos) == BAR_POS_RIGHT)
+
 typedef struct Config {
 	BarPosition bar_position;
 	int height;
@@ -45,12 +117,18 @@ typedef struct Config {
 	unsigned long background_colour;
 	unsigned long foreground_colour;
 	unsigned long border_colour;
+	Arena arena;	/* strings and tables parsed from the config, freed with it */
 	char *font;
+	char *font_fallback; /* comma separated, tried before fontconfig */
 
 	/* modules */
 	Module *modules;
 	int module_count;
 	int max_modules;
+	int marquee_fps;
+	int battery_multiplier;	/* stretches every interval while discharging, 1 to disable */
+	int timer_slack;		/* modules due this many milliseconds early run in the same wakeup */
+	SpawnOpts spawn;
 
 	/* workspace customization */
 	char **ws_labels;
@@ -63,6 +141,7 @@ typedef struct Config {
 	int ws_pad_right;
 	int ws_spacing;
 	WorkspacePosition ws_position;
+	int ws_per_monitor;	/* each bar keeps the desktop last switched to on its monitor */
 } Config;
 
 typedef void (*EventHandler)(XEvent *);
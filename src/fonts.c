@@ -0,0 +1,267 @@
+/*
+ * Font fallback chain. fonts[0] is the configured font, followed by the font_fallback list
+ * and then any font fontconfig found for a codepoint nothing else covered. The font chosen
+ * for each codepoint is memoised in a two-level page table, so fontconfig is asked at most
+ * once per codepoint.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fontconfig/fontconfig.h>
+#include <X11/Xlib.h>
+#include <X11/Xft/Xft.h>
+
+#include "fonts.h"
+
+#define CP_MAX		0x110000
+#define PAGE_BITS	8
+#define PAGE_SIZE	(1 << PAGE_BITS)
+
+static Display *fdpy;
+static int fscr;
+static XftFont *fonts[MAX_FONTS];
+static int nfonts;
+static FcPattern *request; /* what the user asked for, the base of fallback queries */
+
+/* font index + 1 per codepoint, 0 while unresolved; pages are allocated on first use */
+static unsigned char *pages[CP_MAX >> PAGE_BITS];
+
+/* kept alongside the page table for --mem-report: pages in use, codepoints per font */
+static int n_pages;
+static int resolved[MAX_FONTS];
+
+static XftFont *open_sized(const char *name, int size)
+{
+	XftFont *f = NULL;
+	if (size > 0) {
+		char spec[256];
+		snprintf(spec, sizeof spec, "%s:pixelsize=%d", name, size);
+		f = XftFontOpenName(fdpy, fscr, spec);
+	}
+	if (!f) {
+		f = XftFontOpenName(fdpy, fscr, name);
+	}
+	return f;
+}
+
+XftFont *fonts_open(Display *dpy, int scr, const char *name, int size, const char *fallback)
+{
+	fdpy = dpy;
+	fscr = scr;
+	if (!(fonts[0] = open_sized(name, size))) {
+		return NULL;
+	}
+	nfonts = 1;
+	if ((request = FcNameParse((const FcChar8 *)name)) && size > 0) {
+		FcPatternDel(request, FC_PIXEL_SIZE);
+		FcPatternAddDouble(request, FC_PIXEL_SIZE, size);
+	}
+
+	/* comma separated fallback families, tried in order before asking fontconfig */
+	if (fallback) {
+		char *list = strdup(fallback);
+		for (char *tok = strtok(list, ","); tok && nfonts < MAX_FONTS; tok = strtok(NULL, ",")) {
+			while (*tok == ' ' || *tok == '\t') {
+				tok++;
+			}
+			char *end = tok + strlen(tok);
+			while (end > tok && (end[-1] == ' ' || end[-1] == '\t')) {
+				*--end = '\0';
+			}
+			if (!*tok) {
+				continue;
+			}
+			XftFont *f = open_sized(tok, size);
+			if (f) {
+				fonts[nfonts++] = f;
+			}
+			else {
+				fprintf(stderr, "sxbar: cannot load fallback font %s\n", tok);
+			}
+		}
+		free(list);
+	}
+	return fonts[0];
+}
+
+void fonts_close(void)
+{
+	for (int i = 0; i < nfonts; i++) {
+		XftFontClose(fdpy, fonts[i]);
+		fonts[i] = NULL;
+	}
+	nfonts = 0;
+	for (size_t i = 0; i < sizeof pages / sizeof *pages; i++) {
+		free(pages[i]);
+		pages[i] = NULL;
+	}
+	n_pages = 0;
+	memset(resolved, 0, sizeof resolved);
+	if (request) {
+		FcPatternDestroy(request);
+		request = NULL;
+	}
+}
+
+/* ask fontconfig for any font covering cp, reusing an open font for the same file */
+static int discover(FcChar32 cp)
+{
+	if (nfonts == MAX_FONTS || !request) {
+		return 0;
+	}
+
+	FcPattern *pat = FcPatternDuplicate(request);
+	FcCharSet *cs = FcCharSetCreate();
+	FcCharSetAddChar(cs, cp);
+	FcPatternAddCharSet(pat, FC_CHARSET, cs);
+	FcCharSetDestroy(cs);
+	FcConfigSubstitute(NULL, pat, FcMatchPattern);
+	FcDefaultSubstitute(pat);
+
+	FcResult result;
+	FcPattern *match = FcFontMatch(NULL, pat, &result);
+	FcPatternDestroy(pat);
+	if (!match) {
+		return 0;
+	}
+
+	FcChar8 *file = NULL;
+	FcPatternGetString(match, FC_FILE, 0, &file);
+	for (int i = 0; file && i < nfonts; i++) {
+		FcChar8 *other = NULL;
+		if (FcPatternGetString(fonts[i]->pattern, FC_FILE, 0, &other) == FcResultMatch &&
+			!strcmp((const char *)file, (const char *)other)) {
+			FcPatternDestroy(match);
+			return XftCharExists(fdpy, fonts[i], cp) ? i : 0;
+		}
+	}
+
+	XftFont *f = XftFontOpenPattern(fdpy, match);
+	if (!f) {
+		FcPatternDestroy(match);
+		return 0;
+	}
+	if (!XftCharExists(fdpy, f, cp)) {
+		XftFontClose(fdpy, f);
+		return 0;
+	}
+	fonts[nfonts] = f;
+	return nfonts++;
+}
+
+int fonts_index(FcChar32 cp)
+{
+	if (cp >= CP_MAX) {
+		return 0;
+	}
+	unsigned char **page = &pages[cp >> PAGE_BITS];
+	if (!*page) {
+		*page = calloc(PAGE_SIZE, 1);
+		n_pages++;
+	}
+	unsigned char *slot = &(*page)[cp & (PAGE_SIZE - 1)];
+	if (*slot) {
+		return *slot - 1;
+	}
+
+	int idx = -1;
+	for (int i = 0; i < nfonts; i++) {
+		if (XftCharExists(fdpy, fonts[i], cp)) {
+			idx = i;
+			break;
+		}
+	}
+	if (idx < 0) {
+		/* unknown glyphs fall back to the main font's box once discovery fails */
+		idx = discover(cp);
+	}
+	*slot = idx + 1;
+	resolved[idx]++;
+	return idx;
+}
+
+XftFont *fonts_get(int idx)
+{
+	return fonts[idx];
+}
+
+/*
+ * split off the next run of *s drawn with one font: returns its byte length, stores the font
+ * index in *idx and advances *s / *len past it; 0 at the end of the string
+ */
+int fonts_next_run(const char **s, int *len, int *idx)
+{
+	int run = 0;
+	*idx = -1;
+
+	while (*len > 0) {
+		FcChar32 cp;
+		int used = FcUtf8ToUcs4((const FcChar8 *)*s, &cp, *len);
+		if (used <= 0) {
+			/* invalid utf-8: swallow the rest with the current font */
+			used = *len;
+			cp = 0;
+		}
+		int fi = fonts_index(cp);
+		if (*idx >= 0 && fi != *idx) {
+			break;
+		}
+		*idx = fi;
+		*s += used;
+		*len -= used;
+		run += used;
+	}
+	return run;
+}
+
+int fonts_text_width(const char *s)
+{
+	int len = strlen(s);
+	int x = 0, ink_right = 0, idx;
+	const char *p = s;
+
+	for (int run; (run = fonts_next_run(&p, &len, &idx)) > 0;) {
+		XGlyphInfo ext;
+		XftTextExtentsUtf8(fdpy, fonts[idx], (const FcChar8 *)(p - run), run, &ext);
+		if (x + ext.x + (int)ext.width > ink_right) {
+			ink_right = x + ext.x + (int)ext.width;
+		}
+		x += ext.xOff;
+	}
+	return ink_right > x ? ink_right : x;
+}
+
+/*
+ * estimate Xft's glyph cache without touching it: every codepoint resolved so far counts as
+ * one A8 cell of its font, rows padded to 4 bytes; *tables is our own page table
+ */
+void fonts_memory(size_t *glyphs, size_t *tables, int *codepoints)
+{
+	*glyphs = 0;
+	*tables = (size_t)n_pages * PAGE_SIZE;
+	*codepoints = 0;
+	for (int i = 0; i < nfonts; i++) {
+		size_t cell = (size_t)((fonts[i]->max_advance_width + 3) & ~3) * fonts[i]->height;
+		*glyphs += cell * resolved[i];
+		*codepoints += resolved[i];
+	}
+}
+
+void fonts_draw(XftDraw *xd, const XftColor *col, int x, int y, const char *s)
+{
+	int len = strlen(s);
+	int idx;
+	const char *p = s;
+
+	for (int run; (run = fonts_next_run(&p, &len, &idx)) > 0;) {
+		const FcChar8 *str = (const FcChar8 *)(p - run);
+		XftDrawStringUtf8(xd, col, fonts[idx], x, y, str, run);
+		if (len > 0) {
+			XGlyphInfo ext;
+			XftTextExtentsUtf8(fdpy, fonts[idx], str, run, &ext);
+			x += ext.xOff;
+		}
+	}
+}
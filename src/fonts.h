@@ -0,0 +1,15 @@
+#pragma once
+
+#include <X11/Xlib.h>
+#include <X11/Xft/Xft.h>
+
+#define MAX_FONTS 32
+
+XftFont *fonts_open(Display *dpy, int scr, const char *name, int size, const char *fallback);
+void fonts_close(void);
+int fonts_index(FcChar32 cp);
+XftFont *fonts_get(int idx);
+int fonts_next_run(const char **s, int *len, int *idx);
+int fonts_text_width(const char *s);
+void fonts_draw(XftDraw *xd, const XftColor *col, int x, int y, const char *s);
+void fonts_memory(size_t *glyphs, size_t *tables, int *codepoints);
@@ -0,0 +1,159 @@
+/*
+ * Inline markup in module output: ^fg(#rrggbb) switches the text colour, ^fg() goes back
+ * to the bar foreground. Anything else starting with ^ is printed as is.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xft/Xft.h>
+
+#include "markup.h"
+
+/*
+ * colours handed out so far, keyed by rgb; they live until the bar exits. Entries are
+ * allocated one by one because runs keep pointers to them across cache growth.
+ */
+typedef struct Colour {
+	unsigned int rgb;
+	XftColor col;
+} Colour;
+
+static Colour **colours;
+static int ncolours;
+
+static int hexval(int c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+/* length of a ^fg(...) tag at s, 0 if s does not start one; *reset for ^fg() */
+static int parse_tag(const char *s, unsigned int *rgb, int *reset)
+{
+	if (strncmp(s, "^fg(", 4)) {
+		return 0;
+	}
+	if (s[4] == ')') {
+		*reset = 1;
+		return 5;
+	}
+	if (s[4] != '#') {
+		return 0;
+	}
+	/* the digits are checked first so a truncated tag never reads past the nul */
+	unsigned int v = 0;
+	for (int i = 5; i < 11; i++) {
+		int d = hexval((unsigned char)s[i]);
+		if (d < 0) {
+			return 0;
+		}
+		v = v << 4 | d;
+	}
+	if (s[11] != ')') {
+		return 0;
+	}
+	*rgb = v;
+	*reset = 0;
+	return 12;
+}
+
+static void push_run(MarkupRun **runs, int *n, int *cap, const char *text, size_t len,
+		int has_fg, unsigned int rgb)
+{
+	if (!len) {
+		return;
+	}
+	if (*n == *cap) {
+		*cap *= 2;
+		*runs = realloc(*runs, *cap * sizeof **runs);
+	}
+	MarkupRun *r = &(*runs)[(*n)++];
+	r->text = malloc(len + 1);
+	memcpy(r->text, text, len);
+	r->text[len] = '\0';
+	r->has_fg = has_fg;
+	r->rgb = rgb;
+	r->fg = NULL;
+	r->width = 0;
+}
+
+/* split s into runs; *runs is always allocated, even when no run comes out */
+int markup_parse(const char *s, MarkupRun **runs)
+{
+	int n = 0, cap = 4;
+	int has_fg = 0;
+	unsigned int rgb = 0;
+	const char *start = s;
+
+	*runs = malloc(cap * sizeof **runs);
+	for (const char *p = s; *p;) {
+		unsigned int next;
+		int reset, len;
+		if (*p != '^' || !(len = parse_tag(p, &next, &reset))) {
+			p++;
+			continue;
+		}
+		push_run(runs, &n, &cap, start, p - start, has_fg, rgb);
+		has_fg = !reset;
+		rgb = reset ? 0 : next;
+		p += len;
+		start = p;
+	}
+	push_run(runs, &n, &cap, start, strlen(start), has_fg, rgb);
+	return n;
+}
+
+void markup_free(MarkupRun *runs, int n)
+{
+	for (int i = 0; i < n; i++) {
+		free(runs[i].text);
+	}
+	free(runs);
+}
+
+const XftColor *markup_colour(Display *dpy, int scr, unsigned int rgb)
+{
+	for (int i = 0; i < ncolours; i++) {
+		if (colours[i]->rgb == rgb) {
+			return &colours[i]->col;
+		}
+	}
+
+	XftColor col;
+	XRenderColor rc = {
+		.red = ((rgb >> 16) & 0xff) * 0x101,
+		.green = ((rgb >> 8) & 0xff) * 0x101,
+		.blue = (rgb & 0xff) * 0x101,
+		.alpha = 0xffff,
+	};
+	if (!XftColorAllocValue(dpy, DefaultVisual(dpy, scr), DefaultColormap(dpy, scr), &rc, &col)) {
+		return NULL;
+	}
+	Colour *c = malloc(sizeof *c);
+	c->rgb = rgb;
+	c->col = col;
+	colours = realloc(colours, (ncolours + 1) * sizeof *colours);
+	colours[ncolours++] = c;
+	return &c->col;
+}
+
+void markup_colours_free(Display *dpy, int scr)
+{
+	for (int i = 0; i < ncolours; i++) {
+		XftColorFree(dpy, DefaultVisual(dpy, scr), DefaultColormap(dpy, scr), &colours[i]->col);
+		free(colours[i]);
+	}
+	free(colours);
+	colours = NULL;
+	ncolours = 0;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <X11/Xlib.h>
+#include <X11/Xft/Xft.h>
+
+/* a span of module output drawn in one colour */
+typedef struct MarkupRun {
+	char *text;
+	int has_fg;
+	unsigned int rgb;	/* 0xrrggbb, valid when has_fg */
+	const XftColor *fg;	/* resolved by the bar, NULL for the default foreground */
+	int width;
+} MarkupRun;
+
+int markup_parse(const char *s, MarkupRun **runs);
+void markup_free(MarkupRun *runs, int n);
+const XftColor *markup_colour(Display *dpy, int scr, unsigned int rgb);
+void markup_colours_free(Display *dpy, int scr);
@@ -0,0 +1,168 @@
+/*
+ * --mem-report: where sxbar's memory goes, for budgeting it on small machines. Heap and RSS
+ * come from glibc and /proc, the rest is counted from our own structures; glyph and pixmap
+ * memory lives in the X server but is charged to the bar all the same.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xinerama.h>
+
+#include "defs.h"
+#include "atlas.h"
+#ifdef SXBAR_CLIENT_RENDER
+#include "canvas.h"
+#endif
+#include "fonts.h"
+#include "memreport.h"
+#include "modules.h"
+
+extern Display *dpy;
+extern int scr;
+extern Config config;
+extern XineramaScreenInfo *monitors;
+extern int n_monitors;
+extern Atlas *atlas;
+#ifdef SXBAR_CLIENT_RENDER
+extern Canvas **canvases;
+#endif
+
+void bar_geometry(const XineramaScreenInfo *m, int *x, int *y, int *w, int *h);
+
+static const char *human(size_t bytes, char *buf, size_t len)
+{
+	if (bytes < 1024) {
+		snprintf(buf, len, "%zu B", bytes);
+	}
+	else if (bytes < 1024 * 1024) {
+		snprintf(buf, len, "%.1f KiB", bytes / 1024.0);
+	}
+	else {
+		snprintf(buf, len, "%.1f MiB", bytes / (1024.0 * 1024.0));
+	}
+	return buf;
+}
+
+/* kB value of a /proc/self/status field, -1 if missing */
+static long proc_status_kb(const char *field)
+{
+	FILE *fp = fopen("/proc/self/status", "r");
+	if (!fp) {
+		return -1;
+	}
+	char line[128];
+	long kb = -1;
+	size_t n = strlen(field);
+	while (fgets(line, sizeof line, fp)) {
+		if (!strncmp(line, field, n) && line[n] == ':') {
+			kb = atol(line + n + 1);
+			break;
+		}
+	}
+	fclose(fp);
+	return kb;
+}
+
+/* bits per pixel the server stores a pixmap of depth with */
+static int pixmap_bpp(int depth)
+{
+	int n, bpp = depth > 16 ? 32 : depth > 8 ? 16 : 8;
+	XPixmapFormatValues *fmts = XListPixmapFormats(dpy, &n);
+	for (int i = 0; fmts && i < n; i++) {
+		if (fmts[i].depth == depth) {
+			bpp = fmts[i].bits_per_pixel;
+		}
+	}
+	if (fmts) {
+		XFree(fmts);
+	}
+	return bpp;
+}
+
+void mem_report(FILE *fp)
+{
+	char a[32], b[32];
+
+	fprintf(fp, "sxbar: memory\n");
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	struct mallinfo2 mi = mallinfo2();
+	fprintf(fp, "  %-14s %s in use, %s held\n", "heap", human(mi.uordblks + mi.hblkhd, a, sizeof a),
+			human(mi.arena + mi.hblkhd, b, sizeof b));
+#else
+	fprintf(fp, "  %-14s n/a\n", "heap");
+#endif
+	long rss = proc_status_kb("VmRSS"), hwm = proc_status_kb("VmHWM");
+	if (rss >= 0) {
+		fprintf(fp, "  %-14s %s (peak %s)\n", "rss", human(rss * 1024, a, sizeof a),
+				human(hwm > 0 ? hwm * 1024 : 0, b, sizeof b));
+	}
+	else {
+		fprintf(fp, "  %-14s n/a\n", "rss");
+	}
+
+	fprintf(fp, "  %-14s %s used of %s\n", "config arena", human(config.arena.used, a, sizeof a),
+			human(config.arena.size, b, sizeof b));
+	size_t out = 0;
+	for (int i = 0; i < config.module_count; i++) {
+		out += config.modules[i].output_cap;
+	}
+	fprintf(fp, "  %-14s %s in %d module(s), read buffer %s\n", "module output",
+			human(out, a, sizeof a), config.module_count,
+			human(modules_scratch_bytes(), b, sizeof b));
+
+	size_t glyphs, tables;
+	int cps;
+	fonts_memory(&glyphs, &tables, &cps);
+	fprintf(fp, "  %-14s ~%s for %d codepoint(s), lookup pages %s\n", "xft glyphs",
+			human(glyphs, a, sizeof a), cps, human(tables, b, sizeof b));
+	if (atlas) {
+		atlas_memory(atlas, &glyphs, &tables);
+		fprintf(fp, "  %-14s %s uploaded, tables %s\n", "glyph atlas", human(glyphs, a, sizeof a),
+				human(tables, b, sizeof b));
+	}
+
+#ifdef SXBAR_CLIENT_RENDER
+	/* client-side frames: the shared image plus the shadow of what was uploaded */
+	size_t images = 0;
+	for (int i = 0; canvases && i < n_monitors; i++) {
+		images += canvas_memory(canvases[i]);
+	}
+	if (images) {
+		fprintf(fp, "  %-14s %s, glyph bitmaps %s\n", "canvases", human(images, a, sizeof a),
+				human(canvas_glyph_memory(), b, sizeof b));
+	}
+#endif
+
+	/* the back buffer of each bar, strips are shared by every monitor */
+	int depth = DefaultDepth(dpy, scr);
+	int bpp = pixmap_bpp(depth);
+	size_t total = 0;
+	for (int i = 0; i < n_monitors; i++) {
+		int x, y, w, h;
+		bar_geometry(&monitors[i], &x, &y, &w, &h);
+		size_t bytes = (size_t)w * h * bpp / 8;
+		total += bytes;
+		fprintf(fp, "  %-14s monitor %d %dx%d, %s\n", i ? "" : "pixmaps", i, w, h,
+				human(bytes, a, sizeof a));
+	}
+	size_t strips = 0;
+	for (int i = 0; i < config.module_count; i++) {
+		const Module *m = &config.modules[i];
+		if (m->strip) {
+			int x, y, w, h;
+			bar_geometry(&monitors[0], &x, &y, &w, &h);
+			strips += (size_t)m->strip_w * (m->marquee ? 2 : 1) * h * bpp / 8;
+		}
+	}
+	if (strips) {
+		fprintf(fp, "  %-14s marquee strips, %s\n", "", human(strips, a, sizeof a));
+	}
+	fprintf(fp, "  %-14s total %s at %d bpp\n", "", human(total + strips, a, sizeof a), bpp);
+	fflush(fp);
+}
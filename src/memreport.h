@@ -0,0 +1,5 @@
+#pragma once
+
+#include <stdio.h>
+
+void mem_report(FILE *fp);
@@ -1,89 +1,556 @@
-#define _POSIX_C_SOURCE 200809L
+/* sched_setaffinity(), SCHED_IDLE and SCHED_BATCH are Linux extensions */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "defs.h"
+#include "markup.h"
 #include "modules.h"
 
+#define POWER_RECHECK 30
+
 extern Config config;
 
-static char *run_command(const char *cmd)
+static int watch_fd = -1;
+
+/* every command and file is read into this one buffer, modules keep their own copy */
+static char *scratch;
+static size_t scratch_cap;
+
+/* click actions still running, each refreshes the module it was started from on exit */
+typedef struct Action {
+	pid_t pid;
+	int module;
+} Action;
+
+static Action *actions;
+static int n_actions;
+
+static int parse_cpus(const char *list, cpu_set_t *set)
 {
-	if (!cmd || !*cmd) {
-		return strdup("");
+	CPU_ZERO(set);
+	for (const char *p = list; *p;) {
+		char *end;
+		long lo = strtol(p, &end, 10), hi = lo;
+		if (end == p) {
+			return -1;
+		}
+		if (*end == '-') {
+			p = end + 1;
+			hi = strtol(p, &end, 10);
+			if (end == p || hi < lo) {
+				return -1;
+			}
+		}
+		for (long c = lo; c <= hi && c < CPU_SETSIZE; c++) {
+			CPU_SET(c, set);
+		}
+		p = *end == ',' ? end + 1 : end;
+		if (*end && *end != ',') {
+			return -1;
+		}
+	}
+	return CPU_COUNT(set) ? 0 : -1;
+}
+
+/* move the calling process into a cgroup v2 leaf, creating it if our cgroup lets us */
+static void join_cgroup(const char *leaf)
+{
+	char path[PATH_MAX];
+	if (leaf[0] == '/') {
+		snprintf(path, sizeof path, "/sys/fs/cgroup%s", leaf);
+	}
+	else {
+		/* the v2 entry of /proc/self/cgroup is "0::/path/of/our/cgroup" */
+		char self[PATH_MAX] = "";
+		int fd = open("/proc/self/cgroup", O_RDONLY);
+		if (fd < 0) {
+			return;
+		}
+		ssize_t n = read(fd, self, sizeof self - 1);
+		close(fd);
+		char *v2 = n > 0 ? strstr(self, "0::") : NULL;
+		if (!v2) {
+			return;
+		}
+		v2 += 3;
+		v2[strcspn(v2, "\n")] = '\0';
+		snprintf(path, sizeof path, "/sys/fs/cgroup%s/%s", strcmp(v2, "/") ? v2 : "", leaf);
 	}
 
-	FILE *fp = popen(cmd, "r");
-	if (!fp) {
-		return strdup("N/A");
+	mkdir(path, 0755);
+	size_t len = strlen(path);
+	snprintf(path + len, sizeof path - len, "/cgroup.procs");
+	int fd = open(path, O_WRONLY);
+	if (fd >= 0) {
+		/* "0" stands for the writing process */
+		ssize_t w = write(fd, "0", 1);
+		(void)w;
+		close(fd);
 	}
+}
 
-	char buffer[1024];
-	char *res = NULL;
-	size_t len = 0;
+/* runs in the forked child; every knob is best effort so the command always starts */
+static void apply_spawn(const SpawnOpts *mod, const SpawnOpts *glob)
+{
+	const char *cgroup = mod->cgroup ? mod->cgroup : glob->cgroup;
+	const char *cpus = mod->cpus ? mod->cpus : glob->cpus;
+	SpawnSched sched = mod->sched ? mod->sched : glob->sched;
 
-	while (fgets(buffer, sizeof buffer, fp)) {
-		size_t l = strlen(buffer);
-		if (l > 0 && buffer[l - 1] == '\n') {
-			buffer[--l] = '\0';
+	if (cgroup) {
+		join_cgroup(cgroup);
+	}
+	if (cpus) {
+		cpu_set_t set;
+		if (parse_cpus(cpus, &set) == 0) {
+			sched_setaffinity(0, sizeof set, &set);
 		}
+	}
+	if (sched != SPAWN_SCHED_INHERIT) {
+		struct sched_param sp = {.sched_priority = 0};
+		int policy = sched == SPAWN_SCHED_IDLE ? SCHED_IDLE
+			: sched == SPAWN_SCHED_BATCH ? SCHED_BATCH : SCHED_OTHER;
+		sched_setscheduler(0, policy, &sp);
+	}
+	if (mod->nice_set || glob->nice_set) {
+		setpriority(PRIO_PROCESS, 0, mod->nice_set ? mod->nice : glob->nice);
+	}
+}
 
-		if (!res) {
-			res = malloc(l + 1);
-			if (!res) {
+/*
+ * read fd to EOF into the scratch buffer, valid until the next read; trailing newlines go,
+ * inner ones become spaces
+ */
+static const char *read_output(int fd)
+{
+	size_t len = 0;
+	if (!scratch) {
+		if (!(scratch = malloc(256))) {
+			return "";
+		}
+		scratch_cap = 256;
+	}
+	char *res = scratch;
+	for (;;) {
+		if (len + 1 == scratch_cap) {
+			/* out of memory keeps what was read, the writer gets EPIPE once we close */
+			char *grown = realloc(scratch, scratch_cap * 2);
+			if (!grown) {
 				break;
 			}
-			strcpy(res, buffer);
-			len = l;
+			res = scratch = grown;
+			scratch_cap *= 2;
 		}
-		else {
-			char *tmp = realloc(res, len + l + 2);
-			if (!tmp) {
-				break;
+		ssize_t n = read(fd, res + len, scratch_cap - len - 1);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		len += n;
+	}
+
+	while (len > 0 && res[len - 1] == '\n') {
+		len--;
+	}
+	res[len] = '\0';
+	for (char *p = res; (p = memchr(p, '\n', res + len - p)); p++) {
+		*p = ' ';
+	}
+	return res;
+}
+
+static const char *run_command(const Module *m)
+{
+	const char *cmd = m->command;
+	if (!cmd || !*cmd) {
+		return "";
+	}
+
+	int fds[2];
+	if (pipe(fds) < 0) {
+		return "N/A";
+	}
+	pid_t pid = fork();
+	if (pid < 0) {
+		close(fds[0]);
+		close(fds[1]);
+		return "N/A";
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		if (fds[1] != STDOUT_FILENO) {
+			dup2(fds[1], STDOUT_FILENO);
+			close(fds[1]);
+		}
+		apply_spawn(&m->spawn, &config.spawn);
+		execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+		_exit(127);
+	}
+	close(fds[1]);
+
+	const char *res = read_output(fds[0]);
+	close(fds[0]);
+	while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {
+	}
+	return res;
+}
+
+/*
+ * copy out into the module's own buffer, NULL clears it; styled runs are only thrown away
+ * when the text really changed, which is also what the return value says
+ */
+int module_set_output(Module *m, const char *out)
+{
+	if (m->cached_output && out && !strcmp(m->cached_output, out)) {
+		return False;
+	}
+	if (!out) {
+		free(m->cached_output);
+		m->cached_output = NULL;
+		m->output_cap = 0;
+	}
+	else {
+		size_t len = strlen(out) + 1;
+		if (len > m->output_cap) {
+			/* headroom so output that grows by a digit now and then stays in place */
+			m->output_cap = len < 64 ? 64 : len + len / 2;
+			m->cached_output = realloc(m->cached_output, m->output_cap);
+		}
+		memcpy(m->cached_output, out, len);
+	}
+	markup_free(m->runs, m->run_count);
+	m->runs = NULL;
+	m->run_count = 0;
+	m->width = 0;
+	m->changed = True;
+	return True;
+}
+
+void cleanup_modules(Config *cfg)
+{
+	for (int i = 0; i < cfg->module_count; i++) {
+		/* name, command, path and spawn strings belong to the config's arena */
+		free(cfg->modules[i].cached_output);
+		markup_free(cfg->modules[i].runs, cfg->modules[i].run_count);
+	}
+	free(cfg->modules);
+	cfg->modules = NULL;
+	cfg->module_count = 0;
+	cfg->max_modules = 0;
+}
+
+/* true while a battery is discharging, rechecked at most every POWER_RECHECK seconds */
+static int on_battery(time_t now)
+{
+	static time_t checked;
+	static int discharging;
+	if (checked && now - checked < POWER_RECHECK) {
+		return discharging;
+	}
+	checked = now;
+	discharging = False;
+
+	DIR *dir = opendir("/sys/class/power_supply");
+	if (!dir) {
+		return False;
+	}
+	for (struct dirent *de; (de = readdir(dir)) && !discharging;) {
+		char path[PATH_MAX], type[32] = "", status[32] = "";
+		if (de->d_name[0] == '.') {
+			continue;
+		}
+		snprintf(path, sizeof path, "/sys/class/power_supply/%s/type", de->d_name);
+		FILE *fp = fopen(path, "r");
+		if (!fp) {
+			continue;
+		}
+		if (!fgets(type, sizeof type, fp)) {
+			type[0] = '\0';
+		}
+		fclose(fp);
+		if (strncmp(type, "Battery", 7)) {
+			continue;
+		}
+		snprintf(path, sizeof path, "/sys/class/power_supply/%s/status", de->d_name);
+		if ((fp = fopen(path, "r"))) {
+			if (fgets(status, sizeof status, fp) && !strncmp(status, "Discharging", 11)) {
+				discharging = True;
 			}
-			res = tmp;
-			strcat(res, " ");
-			strcat(res, buffer);
-			len += l + 1;
+			fclose(fp);
 		}
 	}
-	pclose(fp);
-	return res ? res : strdup("");
+	closedir(dir);
+	return discharging;
+}
+
+long long monotonic_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
 }
 
-void cleanup_modules(void)
+static long long due_at(const Module *m, long long now)
 {
+	if (!m->last_update) {
+		return now;
+	}
+	long long iv = m->cur_interval > 0 ? m->cur_interval : m->refresh_interval;
+	if (config.battery_multiplier > 1 && on_battery(now / 1000)) {
+		iv *= config.battery_multiplier;
+	}
+	return m->last_update + iv;
+}
+
+static int polled(const Module *m)
+{
+	/* built-in modules are fed by X events, not polled */
+	return m->enabled && m->type == MODULE_COMMAND;
+}
+
+/* when the next polled module is due on the monotonic clock, -1 if none is */
+long long modules_next_deadline(void)
+{
+	long long now = monotonic_ms(), next = -1;
 	for (int i = 0; i < config.module_count; i++) {
-		free(config.modules[i].name);
-		free(config.modules[i].command);
-		free(config.modules[i].cached_output);
+		const Module *m = &config.modules[i];
+		if (!polled(m)) {
+			continue;
+		}
+		long long due = due_at(m, now);
+		if (next < 0 || due < next) {
+			next = due;
+		}
 	}
-	free(config.modules);
-	config.modules = NULL;
-	config.module_count = 0;
-	config.max_modules = 0;
+	return next;
 }
 
-void update_modules(void)
+/* run every due module, returns true if any output changed */
+int update_modules(void)
 {
-	time_t now = time(NULL);
+	long long now = monotonic_ms();
+	int changed = False;
+
+	/* once something is due anyway, pull in whatever falls due within the slack too */
+	long long horizon = now;
 	for (int i = 0; i < config.module_count; i++) {
 		Module *m = &config.modules[i];
+		if (polled(m) && due_at(m, now) <= now) {
+			horizon = now + (config.timer_slack > 0 ? config.timer_slack : 0);
+			break;
+		}
+	}
 
-		if (!m->enabled) {
+	for (int i = 0; i < config.module_count; i++) {
+		Module *m = &config.modules[i];
+		if (!polled(m)) {
 			continue;
 		}
-
 		if (m->refresh_interval <= 0) {
-			m->refresh_interval = 1;
+			m->refresh_interval = 1000;
+		}
+		if (due_at(m, now) > horizon) {
+			continue;
+		}
+
+		if (module_set_output(m, run_command(m))) {
+			changed = True;
+			m->unchanged = 0;
+			m->cur_interval = m->refresh_interval;
+		}
+		else if (m->backoff > 0 && ++m->unchanged >= m->backoff) {
+			int ceiling = m->max_interval > 0 ? m->max_interval : 8 * m->refresh_interval;
+			int cur = m->cur_interval > 0 ? m->cur_interval : m->refresh_interval;
+			m->cur_interval = cur * 2 < ceiling ? cur * 2 : ceiling;
+			m->unchanged = 0;
+		}
+		m->last_update = now;
+	}
+	return changed;
+}
+
+/*
+ * start a click action in a session of its own with stdin on /dev/null, so it outlives
+ * the bar and never reads the status stream; nothing waits for it here
+ */
+int module_action(int index, const char *cmd)
+{
+	pid_t pid = fork();
+	if (pid < 0) {
+		return -1;
+	}
+	if (pid == 0) {
+		setsid();
+		int fd = open("/dev/null", O_RDONLY);
+		if (fd > STDIN_FILENO) {
+			dup2(fd, STDIN_FILENO);
+			close(fd);
+		}
+		execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+		_exit(127);
+	}
+	actions = realloc(actions, (n_actions + 1) * sizeof *actions);
+	actions[n_actions++] = (Action){pid, index};
+	return 0;
+}
+
+/*
+ * collect finished actions and make their modules due right away, so a volume change shows
+ * as soon as the command made it; returns true if any module became due
+ */
+int modules_reap_actions(void)
+{
+	int due = False;
+	for (int i = 0; i < n_actions;) {
+		pid_t r = waitpid(actions[i].pid, NULL, WNOHANG);
+		if (r == 0 || (r < 0 && errno == EINTR)) {
+			i++;
+			continue;
+		}
+		if (actions[i].module >= 0) {
+			Module *m = &config.modules[actions[i].module];
+			m->last_update = 0;
+			m->cur_interval = 0;
+			m->unchanged = 0;
+			due = True;
+		}
+		actions[i] = actions[--n_actions];
+	}
+	return due;
+}
+
+/* a reload renumbers modules: running actions are still reaped but refresh nothing */
+void modules_actions_forget(void)
+{
+	for (int i = 0; i < n_actions; i++) {
+		actions[i].module = -1;
+	}
+}
+
+void modules_actions_free(void)
+{
+	free(actions);
+	actions = NULL;
+	n_actions = 0;
+}
+
+static const char *read_file(const char *path)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return "";
+	}
+	const char *res = read_output(fd);
+	close(fd);
+	return res;
+}
+
+static const char *base_name(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	return slash ? slash + 1 : path;
+}
+
+/*
+ * (re)build the inotify watches for file modules and read each file once. The directory
+ * is watched rather than the file so that replacing it by rename keeps being noticed.
+ */
+void modules_watch(void)
+{
+	modules_watch_close();
+	for (int i = 0; i < config.module_count; i++) {
+		Module *m = &config.modules[i];
+		m->wd = 0;
+		if (!m->enabled || m->type != MODULE_FILE || !m->path) {
+			continue;
+		}
+		if (watch_fd < 0 && (watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+			fprintf(stderr, "sxbar: inotify_init1 failed\n");
+			return;
+		}
+
+		char dir[PATH_MAX];
+		const char *base = base_name(m->path);
+		if (base == m->path) {
+			strcpy(dir, ".");
+		}
+		else {
+			snprintf(dir, sizeof dir, "%.*s", (int)(base - m->path - 1), m->path);
+			if (!*dir) {
+				strcpy(dir, "/");
+			}
 		}
+		if ((m->wd = inotify_add_watch(watch_fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO)) < 0) {
+			fprintf(stderr, "sxbar: cannot watch %s\n", dir);
+			m->wd = 0;
+		}
+		module_set_output(m, read_file(m->path));
+	}
+}
+
+/* the inotify fd for the main loop to poll, -1 while no module watches a file */
+int modules_watch_fd(void)
+{
+	return watch_fd;
+}
+
+/* drain pending inotify events, re-reading the files they name; true if any output changed */
+int modules_watch_read(void)
+{
+	union {
+		struct inotify_event ev;	/* for alignment */
+		char buf[4096];
+	} u;
+	int changed = False;
 
-		if (now - m->last_update >= m->refresh_interval) {
-			free(m->cached_output);
-			m->cached_output = run_command(m->command);
-			m->last_update = now;
+	while (watch_fd >= 0) {
+		ssize_t n = read(watch_fd, u.buf, sizeof u.buf);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
 		}
+		for (char *p = u.buf; p < u.buf + n;) {
+			const struct inotify_event *ev = (const struct inotify_event *)p;
+			p += sizeof *ev + ev->len;
+			if (!ev->len) {
+				continue;
+			}
+			for (int i = 0; i < config.module_count; i++) {
+				Module *m = &config.modules[i];
+				if (m->wd && m->wd == ev->wd && !strcmp(base_name(m->path), ev->name)) {
+					changed |= module_set_output(m, read_file(m->path));
+				}
+			}
+		}
+	}
+	return changed;
+}
+
+void modules_watch_close(void)
+{
+	if (watch_fd >= 0) {
+		close(watch_fd);
+		watch_fd = -1;
 	}
 }
+
+/* bytes of the shared read buffer, for --mem-report */
+size_t modules_scratch_bytes(void)
+{
+	return scratch_cap;
+}
@@ -1,4 +1,18 @@
 #pragma once
 
-void update_modules(void);
-void cleanup_modules(void);
+#include "defs.h"
+
+int module_set_output(Module *m, const char *out);
+long long modules_next_deadline(void);
+long long monotonic_ms(void);
+int update_modules(void);
+void modules_watch(void);
+int modules_watch_fd(void);
+int modules_watch_read(void);
+void modules_watch_close(void);
+int module_action(int index, const char *cmd);
+int modules_reap_actions(void);
+void modules_actions_forget(void);
+void modules_actions_free(void);
+size_t modules_scratch_bytes(void);
+void cleanup_modules(Config *cfg);
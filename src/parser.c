@@ -1,5 +1,8 @@
 #define _POSIX_C_SOURCE 200809L
 #include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,7 +13,102 @@
 #include "parser.h"
 #include "modules.h"
 
-unsigned long parse_col(const char *hex);
+/* a CONFIG=static build fills Config from config.h and keeps only the helpers below */
+#ifndef SXBAR_STATIC_CONFIG
+int alloc_col(const char *hex, unsigned long *pixel);
+
+typedef int (*KeyHandler)(void *obj, const char *value, size_t off);
+
+/* arena of the config being parsed, where setters put every string they keep */
+static Arena *arena;
+
+typedef struct ConfigKey {
+	const char *key;
+	KeyHandler set;
+	size_t off;
+} ConfigKey;
+
+static int set_bar_position(void *obj, const char *value, size_t off);
+static int set_bool(void *obj, const char *value, size_t off);
+static int set_duration(void *obj, const char *value, size_t off);
+static int set_bottom_bar(void *obj, const char *value, size_t off);
+static int set_colour(void *obj, const char *value, size_t off);
+static int set_font_size(void *obj, const char *value, size_t off);
+static int set_int(void *obj, const char *value, size_t off);
+static int set_interval(void *obj, const char *value, size_t off);
+static int set_module_type(void *obj, const char *value, size_t off);
+static int set_monitors(void *obj, const char *value, size_t off);
+static int set_path(void *obj, const char *value, size_t off);
+static int set_spawn_cgroup(void *obj, const char *value, size_t off);
+static int set_spawn_cpus(void *obj, const char *value, size_t off);
+static int set_spawn_nice(void *obj, const char *value, size_t off);
+static int set_spawn_sched(void *obj, const char *value, size_t off);
+static int set_string(void *obj, const char *value, size_t off);
+static int set_ws_labels(void *obj, const char *value, size_t off);
+static int set_ws_position(void *obj, const char *value, size_t off);
+
+#define CFG(field) offsetof(Config, field)
+#define MOD(field) offsetof(Module, field)
+
+/* both tables must stay sorted by key, they are searched with bsearch() */
+static const ConfigKey global_keys[] = {
+	{"background_colour",              set_colour,       CFG(background_colour)},
+	{"bar_position",                   set_bar_position, CFG(bar_position)},
+	{"battery_multiplier",             set_int,          CFG(battery_multiplier)},
+	{"border",                         set_bool,         CFG(border)},
+	{"border_colour",                  set_colour,       CFG(border_colour)},
+	{"border_width",                   set_int,          CFG(border_width)},
+	{"bottom_bar",                     set_bottom_bar,   CFG(bar_position)},
+	{"font",                           set_string,       CFG(font)},
+	{"font_fallback",                  set_string,       CFG(font_fallback)},
+	{"font_size",                      set_font_size,    CFG(font_size)},
+	{"foreground_colour",              set_colour,       CFG(foreground_colour)},
+	{"height",                         set_int,          CFG(height)},
+	{"horizontal_padding",             set_int,          CFG(horizontal_padding)},
+	{"marquee_fps",                    set_int,          CFG(marquee_fps)},
+	{"spawn.cgroup",                   set_spawn_cgroup, CFG(spawn)},
+	{"spawn.cpus",                     set_spawn_cpus,   CFG(spawn)},
+	{"spawn.nice",                     set_spawn_nice,   CFG(spawn)},
+	{"spawn.sched",                    set_spawn_sched,  CFG(spawn)},
+	{"text_padding",                   set_int,          CFG(text_padding)},
+	{"timer_slack",                    set_duration,     CFG(timer_slack)},
+	{"vertical_padding",               set_int,          CFG(vertical_padding)},
+	{"workspaces.active_background",   set_colour,       CFG(ws_active_bg)},
+	{"workspaces.active_foreground",   set_colour,       CFG(ws_active_fg)},
+	{"workspaces.inactive_background", set_colour,       CFG(ws_inactive_bg)},
+	{"workspaces.inactive_foreground", set_colour,       CFG(ws_inactive_fg)},
+	{"workspaces.labels",              set_ws_labels,    0},
+	{"workspaces.padding_left",        set_int,          CFG(ws_pad_left)},
+	{"workspaces.padding_right",       set_int,          CFG(ws_pad_right)},
+	{"workspaces.per_monitor",         set_bool,         CFG(ws_per_monitor)},
+	{"workspaces.position",            set_ws_position,  CFG(ws_position)},
+	{"workspaces.spacing",             set_int,          CFG(ws_spacing)},
+};
+
+static const ConfigKey module_keys[] = {
+	{"backoff",          set_int,          MOD(backoff)},
+	{"cgroup",           set_spawn_cgroup, MOD(spawn)},
+	{"cmd",              set_string,       MOD(command)},
+	{"command",          set_string,       MOD(command)},
+	{"cpus",             set_spawn_cpus,   MOD(spawn)},
+	{"enabled",          set_bool,         MOD(enabled)},
+	{"interval",         set_interval,     MOD(refresh_interval)},
+	{"marquee",          set_bool,         MOD(marquee)},
+	{"max_interval",     set_interval,     MOD(max_interval)},
+	{"max_width",        set_int,          MOD(max_width)},
+	{"monitors",         set_monitors,     0},
+	{"name",             set_string,       MOD(name)},
+	{"nice",             set_spawn_nice,   MOD(spawn)},
+	{"on_click",         set_string,       MOD(on_click)},
+	{"on_scroll_down",   set_string,       MOD(on_scroll_down)},
+	{"on_scroll_up",     set_string,       MOD(on_scroll_up)},
+	{"path",             set_path,         MOD(path)},
+	{"refresh_interval", set_interval,     MOD(refresh_interval)},
+	{"sched",            set_spawn_sched,  MOD(spawn)},
+	{"type",             set_module_type,  MOD(type)},
+};
+
+#define FIELD(obj, off, type) ((type *)((char *)(obj) + (off)))
 
 static char *skip_spaces(char *s)
 {
@@ -27,6 +125,349 @@ static char *skip_spaces(char *s)
 	return s;
 }
 
+static int cmp_key(const void *key, const void *entry)
+{
+	return strcmp(key, ((const ConfigKey *)entry)->key);
+}
+
+static const ConfigKey *find_key(const ConfigKey *table, size_t n, const char *key)
+{
+	return bsearch(key, table, n, sizeof *table, cmp_key);
+}
+
+static int parse_int(const char *value, int *out)
+{
+	char *end;
+	errno = 0;
+	long v = strtol(value, &end, 10);
+	if (errno || end == value || *end || v < -0x7fffffffL || v > 0x7fffffffL) {
+		return -1;
+	}
+	*out = (int)v;
+	return 0;
+}
+
+static int set_bar_position(void *obj, const char *value, size_t off)
+{
+	BarPosition *pos = FIELD(obj, off, BarPosition);
+	if (!strcasecmp(value, "top")) {
+		*pos = BAR_POS_TOP;
+	}
+	else if (!strcasecmp(value, "bottom")) {
+		*pos = BAR_POS_BOTTOM;
+	}
+	else if (!strcasecmp(value, "left")) {
+		*pos = BAR_POS_LEFT;
+	}
+	else if (!strcasecmp(value, "right")) {
+		*pos = BAR_POS_RIGHT;
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
+static int set_bool(void *obj, const char *value, size_t off)
+{
+	int *b = FIELD(obj, off, int);
+	if (!strcmp(value, "1") || !strcasecmp(value, "true") || !strcasecmp(value, "yes") ||
+		!strcasecmp(value, "on")) {
+		*b = True;
+	}
+	else if (!strcmp(value, "0") || !strcasecmp(value, "false") ||
+		!strcasecmp(value, "no") || !strcasecmp(value, "off")) {
+		*b = False;
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
+static int set_bottom_bar(void *obj, const char *value, size_t off)
+{
+	/* backward compat: map to TOP/BOTTOM if user still uses old key */
+	int bottom;
+	if (set_bool(&bottom, value, 0) < 0) {
+		return -1;
+	}
+	*FIELD(obj, off, BarPosition) = bottom ? BAR_POS_BOTTOM : BAR_POS_TOP;
+	return 0;
+}
+
+static int set_colour(void *obj, const char *value, size_t off)
+{
+	return alloc_col(value, FIELD(obj, off, unsigned long)) ? 0 : -1;
+}
+
+static int set_font_size(void *obj, const char *value, size_t off)
+{
+	int sz;
+	if (parse_int(value, &sz) < 0 || sz <= 0 || sz >= 512) {
+		return -1;
+	}
+	*FIELD(obj, off, int) = sz;
+	return 0;
+}
+
+static int set_int(void *obj, const char *value, size_t off)
+{
+	return parse_int(value, FIELD(obj, off, int));
+}
+
+/*
+ * a duration with an optional ms, s or m suffix, in milliseconds; bare numbers are seconds.
+ * Only plain decimals are taken: strtod() would also accept hex, exponents, inf and nan
+ */
+static int parse_duration(const char *value, int *ms)
+{
+	char *end;
+	errno = 0;
+	double v = strtod(value, &end);
+	if (errno || end == value || !isfinite(v) || v < 0) {
+		return -1;
+	}
+	for (const char *p = value; p < end; p++) {
+		unsigned char ch = *p;
+		if (!isdigit(ch) && ch != '.' && ch != '+' && !isspace(ch)) {
+			return -1;
+		}
+	}
+	while (isspace((unsigned char)*end)) {
+		end++;
+	}
+	if (!strcmp(end, "ms")) {
+		/* already milliseconds */
+	}
+	else if (!*end || !strcmp(end, "s")) {
+		v *= 1000;
+	}
+	else if (!strcmp(end, "m")) {
+		v *= 60000;
+	}
+	else {
+		return -1;
+	}
+	if (v > 0x7fffffff) {
+		return -1;
+	}
+	*ms = (int)(v + 0.5);
+	return 0;
+}
+
+static int set_duration(void *obj, const char *value, size_t off)
+{
+	return parse_duration(value, FIELD(obj, off, int));
+}
+
+static int set_interval(void *obj, const char *value, size_t off)
+{
+	int iv;
+	if (parse_duration(value, &iv) < 0 || iv <= 0) {
+		return -1;
+	}
+	*FIELD(obj, off, int) = iv;
+	return 0;
+}
+
+static int set_module_type(void *obj, const char *value, size_t off)
+{
+	ModuleType *type = FIELD(obj, off, ModuleType);
+	if (!strcasecmp(value, "command")) {
+		*type = MODULE_COMMAND;
+	}
+	else if (!strcasecmp(value, "window_title")) {
+		*type = MODULE_WINDOW_TITLE;
+	}
+	else if (!strcasecmp(value, "file")) {
+		*type = MODULE_FILE;
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
+/* monitor indices and "primary", separated by commas */
+static int set_monitors(void *obj, const char *value, size_t off)
+{
+	Module *m = obj;
+	(void)off;
+
+	m->monitor_mask = 0;
+	m->on_primary = False;
+	for (const char *p = value; *p;) {
+		size_t len = strcspn(p, ",");
+		char tok[16];
+		int n;
+		if (len >= sizeof tok) {
+			return -1;
+		}
+		memcpy(tok, p, len);
+		tok[len] = '\0';
+		char *t = skip_spaces(tok);
+		t[strcspn(t, " \t")] = '\0';
+		if (!strcasecmp(t, "primary")) {
+			m->on_primary = True;
+		}
+		else if (parse_int(t, &n) == 0 && n >= 0 && n < MAX_MONITORS) {
+			m->monitor_mask |= 1u << n;
+		}
+		else {
+			return -1;
+		}
+		p += len;
+		p += *p == ',';
+	}
+	return m->monitor_mask || m->on_primary ? 0 : -1;
+}
+
+/* like set_string, with a leading ~/ expanded to $HOME */
+static int set_path(void *obj, const char *value, size_t off)
+{
+	const char *home = getenv("HOME");
+	if (strncmp(value, "~/", 2) || !home) {
+		return set_string(obj, value, off);
+	}
+	char **str = FIELD(obj, off, char *);
+	size_t len = strlen(home) + strlen(value);
+	*str = arena_alloc(arena, len);
+	snprintf(*str, len, "%s%s", home, value + 1);
+	return 0;
+}
+
+static int set_spawn_cgroup(void *obj, const char *value, size_t off)
+{
+	return set_string(obj, value, off + offsetof(SpawnOpts, cgroup));
+}
+
+static int set_spawn_cpus(void *obj, const char *value, size_t off)
+{
+	/* ranges and single cpus separated by commas, checked properly when applied */
+	if (!*value || strspn(value, "0123456789,-") != strlen(value)) {
+		return -1;
+	}
+	return set_string(obj, value, off + offsetof(SpawnOpts, cpus));
+}
+
+static int set_spawn_nice(void *obj, const char *value, size_t off)
+{
+	SpawnOpts *o = FIELD(obj, off, SpawnOpts);
+	int nice;
+	if (parse_int(value, &nice) < 0 || nice < -20 || nice > 19) {
+		return -1;
+	}
+	o->nice = nice;
+	o->nice_set = True;
+	return 0;
+}
+
+static int set_spawn_sched(void *obj, const char *value, size_t off)
+{
+	SpawnOpts *o = FIELD(obj, off, SpawnOpts);
+	if (!strcasecmp(value, "other")) {
+		o->sched = SPAWN_SCHED_OTHER;
+	}
+	else if (!strcasecmp(value, "batch")) {
+		o->sched = SPAWN_SCHED_BATCH;
+	}
+	else if (!strcasecmp(value, "idle")) {
+		o->sched = SPAWN_SCHED_IDLE;
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
+static int set_string(void *obj, const char *value, size_t off)
+{
+	char **str = FIELD(obj, off, char *);
+	*str = arena_strdup(arena, value);
+	return 0;
+}
+
+static int set_ws_labels(void *obj, const char *value, size_t off)
+{
+	Config *cfg = obj;
+	(void)off;
+
+	/* count first so the table is a single arena allocation */
+	int n = 0;
+	for (const char *p = value + strspn(value, " \t"); *p; p += strspn(p, " \t")) {
+		p += strcspn(p, " \t");
+		n++;
+	}
+	cfg->ws_labels = arena_alloc(arena, n * sizeof *cfg->ws_labels);
+	cfg->ws_label_count = 0;
+
+	/* tokenize by spaces */
+	for (const char *p = value; *p;) {
+		size_t len = strcspn(p, " \t");
+		if (len) {
+			cfg->ws_labels[cfg->ws_label_count++] = arena_strndup(arena, p, len);
+		}
+		p += len;
+		p += strspn(p, " \t");
+	}
+	return 0;
+}
+
+static int set_ws_position(void *obj, const char *value, size_t off)
+{
+	WorkspacePosition *pos = FIELD(obj, off, WorkspacePosition);
+	if (!strcasecmp(value, "left")) {
+		*pos = WS_POS_LEFT;
+	}
+	else if (!strcasecmp(value, "center") || !strcasecmp(value, "centre")) {
+		*pos = WS_POS_CENTER;
+	}
+	else if (!strcasecmp(value, "right")) {
+		*pos = WS_POS_RIGHT;
+	}
+	else {
+		return -1;
+	}
+	return 0;
+}
+
+#endif
+
+/* module idx of cfg, growing the array with disabled modules as needed; NULL past the cap */
+Module *module_slot(Config *cfg, int idx)
+{
+	if (idx < 0 || idx >= MAX_MODULES) {
+		return NULL;
+	}
+	/* ensure capacity */
+	if (idx >= cfg->max_modules) {
+		int new_cap = cfg->max_modules ? cfg->max_modules : 4;
+		while (idx >= new_cap) {
+			new_cap *= 2;
+		}
+		Module *nm = realloc(cfg->modules, new_cap * sizeof(Module));
+		if (!nm) {
+			fprintf(stderr, "sxbar: realloc failed for modules\n");
+			return NULL;
+		}
+		/* zero init new slots */
+		memset(nm + cfg->max_modules, 0, (new_cap - cfg->max_modules) * sizeof(Module));
+		cfg->modules = nm;
+		cfg->max_modules = new_cap;
+	}
+	/* bump count if needed */
+	if (idx >= cfg->module_count) {
+		for (int i = cfg->module_count; i <= idx; i++) {
+			cfg->modules[i].enabled = False;
+			cfg->modules[i].refresh_interval = 1000;
+		}
+		cfg->module_count = idx + 1;
+	}
+	return &cfg->modules[idx];
+}
+
+#ifndef SXBAR_STATIC_CONFIG
 char *get_config_path(void)
 {
 	const char *xdg = getenv("XDG_CONFIG_HOME");
@@ -57,223 +498,99 @@ char *get_config_path(void)
 	return strdup("/usr/local/share/sxbarc");
 }
 
-void parse_config(const char *filepath, Config *cfg)
+int parse_config(const char *filepath, Config *cfg)
 {
 	FILE *fp = fopen(filepath, "r");
 	if (!fp) {
 		fprintf(stderr, "sxbar: cannot open config %s\n", filepath);
-		return;
+		return -1;
 	}
 
+	arena = &cfg->arena;
 	int saw_module_key = 0;
+	int errors = 0;
+	int lineno = 0;
+	char *line = NULL;
+	size_t cap = 0;
+
+	while (getline(&line, &cap, fp) != -1) {
+		lineno++;
 
-	char line[256];
-	while (fgets(line, sizeof line, fp)) {
-		if (!*line || *line == '#') {
+		char *key = skip_spaces(line);
+		if (!*key || *key == '#') {
 			continue;
 		}
 
-		char *key = strtok(line, ":");
-		char *value = strtok(NULL, "\n");
-		if (!key || !value) {
+		char *sep = strchr(key, ':');
+		if (!sep) {
+			fprintf(stderr, "sxbar: %s:%d: expected 'key : value'\n", filepath, lineno);
+			errors++;
 			continue;
 		}
-
+		*sep = '\0';
 		key = skip_spaces(key);
-		value = skip_spaces(value);
-
-		/* workspaces.* handling */
-		if (!strncmp(key, "workspaces.", 11)) {
-			char *field = key + 11;
-
-			if (!strcmp(field, "labels")) {
-				/* free previous */
-				if (cfg->ws_labels) {
-					for (int i = 0; i < cfg->ws_label_count; i++) {
-						free(cfg->ws_labels[i]);
-					}
-					free(cfg->ws_labels);
-					cfg->ws_labels = NULL;
-					cfg->ws_label_count = 0;
-				}
-				/* tokenize by spaces */
-				char *tmp = strdup(value);
-				char *tok = strtok(tmp, " \t");
-				while (tok) {
-					cfg->ws_labels = realloc(cfg->ws_labels, (cfg->ws_label_count + 1) * sizeof *cfg->ws_labels);
-					cfg->ws_labels[cfg->ws_label_count++] = strdup(tok);
-					tok = strtok(NULL, " \t");
-				}
-				free(tmp);
-			}
-			else if (!strcmp(field, "active_background")) {
-				cfg->ws_active_bg = parse_col(value);
-			}
-			else if (!strcmp(field, "active_foreground")) {
-				cfg->ws_active_fg = parse_col(value);
-			}
-			else if (!strcmp(field, "inactive_background")) {
-				cfg->ws_inactive_bg = parse_col(value);
-			}
-			else if (!strcmp(field, "inactive_foreground")) {
-				cfg->ws_inactive_fg = parse_col(value);
-			}
-			else if (!strcmp(field, "padding_left")) {
-				cfg->ws_pad_left = atoi(value);
-			}
-			else if (!strcmp(field, "padding_right")) {
-				cfg->ws_pad_right = atoi(value);
-			}
-			else if (!strcmp(field, "spacing")) {
-				cfg->ws_spacing = atoi(value);
-			}
-			else if (!strcmp(field, "position")) {
-				if (!strcasecmp(value, "left")) {
-					cfg->ws_position = WS_POS_LEFT;
-				}
-				else if (!strcasecmp(value, "center") || !strcasecmp(value, "centre")) {
-					cfg->ws_position = WS_POS_CENTER;
-				}
-				else if (!strcasecmp(value, "right")) {
-					cfg->ws_position = WS_POS_RIGHT;
-				}
-			}
+		char *value = skip_spaces(sep + 1);
+		if (!*value) {
+			fprintf(stderr, "sxbar: %s:%d: missing value for '%s'\n", filepath, lineno, key);
+			errors++;
 			continue;
 		}
 
-		/* module.* handling */
+		const ConfigKey *ck;
+		void *obj = cfg;
+
+		/* module.N.field */
 		if (!strncmp(key, "module.", 7)) {
 			/* 1st time: discard defaults and start fresh */
 			if (!saw_module_key) {
-				cleanup_modules();
-				cfg->max_modules = 4;
-				cfg->modules = calloc(cfg->max_modules, sizeof(Module));
-				cfg->module_count = 0;
+				cleanup_modules(cfg);
 				saw_module_key = 1;
 			}
 
-			char *idx_part = key + 7;
-			char *field = strchr(idx_part, '.');
-			if (!field) {
+			char *end;
+			errno = 0;
+			long idx = strtol(key + 7, &end, 10);
+			if (errno || end == key + 7 || *end != '.' || !end[1] || idx < 0 ||
+				idx >= MAX_MODULES) {
+				fprintf(stderr, "sxbar: %s:%d: bad module key '%s'\n", filepath, lineno, key);
+				errors++;
 				continue;
 			}
-			*field++ = '\0';
-			if (!*idx_part || !*field) {
-				continue;
-			}
-			int idx = atoi(idx_part);
-			if (idx < 0) {
-				continue;
-			}
-
-			/* ensure capacity */
-			if (idx >= cfg->max_modules) {
-				int new_cap = cfg->max_modules;
-				while (idx >= new_cap) {
-					new_cap *= 2;
-				}
-				Module *nm = realloc(cfg->modules, new_cap * sizeof(Module));
-				if (!nm) {
-					fprintf(stderr, "sxbar: realloc failed for modules\n");
-					break;
-				}
-				/* zero init new slots */
-				memset(nm + cfg->max_modules, 0, (new_cap - cfg->max_modules) * sizeof(Module));
-				cfg->modules = nm;
-				cfg->max_modules = new_cap;
-			}
-			/* bump count if needed */
-			if (idx >= cfg->module_count) {
-				for (int i = cfg->module_count; i <= idx; i++) {
-					cfg->modules[i].enabled = False;
-					cfg->modules[i].refresh_interval = 1;
-					cfg->modules[i].last_update = 0;
-					cfg->modules[i].cached_output = NULL;
-					cfg->modules[i].name = NULL;
-					cfg->modules[i].command = NULL;
-				}
-				cfg->module_count = idx + 1;
-			}
-
-			Module *m = &cfg->modules[idx];
-
-			if (!strcmp(field, "name")) {
-				free(m->name);
-				m->name = strdup(value);
-			}
-			else if (!strcmp(field, "cmd") || !strcmp(field, "command")) {
-				free(m->command);
-				m->command = strdup(value);
-			}
-			else if (!strcmp(field, "enabled")) {
-				m->enabled = !strcmp(value, "true") || !strcmp(value, "1") ||
-					!strcasecmp(value, "yes") || !strcasecmp(value, "on");
-			}
-			else if (!strcmp(field, "interval") || !strcmp(field, "refresh_interval")) {
-				int iv = atoi(value);
-				if (iv > 0) {
-					m->refresh_interval = iv;
-				}
-			}
-			continue;
-		}
 
-		/* global keys */
-		if (!strcmp(key, "bottom_bar")) {
-			/* backward compat: map to TOP/BOTTOM if user still uses old key */
-			cfg->bar_position = (!strcmp(value, "true") ? BAR_POS_BOTTOM : BAR_POS_TOP);
-		}
-		else if (!strcmp(key, "bar_position")) {
-			if (!strcasecmp(value, "top")) {
-				cfg->bar_position = BAR_POS_TOP;
-			}
-			else if (!strcasecmp(value, "bottom")) {
-				cfg->bar_position = BAR_POS_BOTTOM;
+			ck = find_key(module_keys, sizeof module_keys / sizeof *module_keys, end + 1);
+			if (ck && !(obj = module_slot(cfg, (int)idx))) {
+				errors++;
+				break;
 			}
-			else if (!strcasecmp(value, "left")) {
-				cfg->bar_position = BAR_POS_LEFT;
-			}
-			else if (!strcasecmp(value, "right")) {
-				cfg->bar_position = BAR_POS_RIGHT;
-			}
-		}
-		else if (!strcmp(key, "height")) {
-			cfg->height = atoi(value);
-		}
-		else if (!strcmp(key, "vertical_padding")) {
-			cfg->vertical_padding = atoi(value);
-		}
-		else if (!strcmp(key, "horizontal_padding")) {
-			cfg->horizontal_padding = atoi(value);
 		}
-		else if (!strcmp(key, "text_padding")) {
-			cfg->text_padding = atoi(value);
+		else {
+			ck = find_key(global_keys, sizeof global_keys / sizeof *global_keys, key);
 		}
-		else if (!strcmp(key, "border")) {
-			cfg->border = !strcmp(value, "true");
-		}
-		else if (!strcmp(key, "border_width")) {
-			cfg->border_width = atoi(value);
-		}
-		else if (!strcmp(key, "background_colour")) {
-			cfg->background_colour = parse_col(value);
-		}
-		else if (!strcmp(key, "foreground_colour")) {
-			cfg->foreground_colour = parse_col(value);
-		}
-		else if (!strcmp(key, "border_colour")) {
-			cfg->border_colour = parse_col(value);
+
+		if (!ck) {
+			fprintf(stderr, "sxbar: %s:%d: unknown key '%s'\n", filepath, lineno, key);
+			errors++;
 		}
-		else if (!strcmp(key, "font")) {
-			free(cfg->font);
-			cfg->font = strdup(value);
-		}
-		else if (!strcmp(key, "font_size")) {
-			int sz = atoi(value);
-			if (sz > 0 && sz < 512) {
-				cfg->font_size = sz;
-			}
+		else if (ck->set(obj, value, ck->off) < 0) {
+			fprintf(stderr, "sxbar: %s:%d: invalid value '%s' for '%s'\n",
+					filepath, lineno, value, key);
+			errors++;
 		}
 	}
+
+	free(line);
 	fclose(fp);
+	return errors;
+}
+#endif
+
+void free_config(Config *cfg)
+{
+	cleanup_modules(cfg);
+	arena_free(&cfg->arena);
+	cfg->font = NULL;
+	cfg->font_fallback = NULL;
+	memset(&cfg->spawn, 0, sizeof cfg->spawn);
+	cfg->ws_labels = NULL;
+	cfg->ws_label_count = 0;
 }
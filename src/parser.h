@@ -4,4 +4,6 @@
 
 
 char *get_config_path(void);
-void parse_config(const char *filepath, Config *cfg);
+int parse_config(const char *filepath, Config *cfg);
+void free_config(Config *cfg);
+Module *module_slot(Config *cfg, int idx);
@@ -0,0 +1,176 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+/* log2 buckets in microseconds, the last one also catches everything above ~33s */
+#define HIST_BUCKETS 26
+
+typedef struct Histogram {
+	const char *name;
+	unsigned long count;
+	unsigned long buckets[HIST_BUCKETS];
+	int64_t min_us;
+	int64_t max_us;
+	int64_t sum_us;
+} Histogram;
+
+/*
+ * queue: server timestamp to sxbar reading the event
+ * draw:  event read to the first draw_bar_into() finishing
+ * flush: event read to every bar being copied (and XSync'd with the probe)
+ * total: queue + flush
+ */
+enum { H_QUEUE, H_DRAW, H_FLUSH, H_TOTAL, H_LAST };
+
+static Histogram hists[H_LAST] = {
+	[H_QUEUE] = {.name = "queue"},
+	[H_DRAW] = {.name = "draw"},
+	[H_FLUSH] = {.name = "flush"},
+	[H_TOTAL] = {.name = "total"},
+};
+
+static int enabled = 0;
+static int sync_probe = 0;
+
+/* the workspace switch currently waiting to reach the screen */
+static int pending = 0;
+static int drawn = 0;
+static int64_t t_event;
+static int64_t t_drawn;
+static int64_t queue_us;
+
+/* smallest (local - server) clock offset seen so far, approximates pure transit */
+static int have_offset = 0;
+static int64_t min_offset_ms;
+
+static int64_t mono_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void hist_add(Histogram *h, int64_t us)
+{
+	if (us < 0) {
+		us = 0;
+	}
+	int b = 0;
+	while (b < HIST_BUCKETS - 1 && us >= ((int64_t)2 << b)) {
+		b++;
+	}
+	h->buckets[b]++;
+	if (h->count == 0 || us < h->min_us) {
+		h->min_us = us;
+	}
+	if (us > h->max_us) {
+		h->max_us = us;
+	}
+	h->sum_us += us;
+	h->count++;
+}
+
+/* upper edge of the bucket holding the p-th percentile */
+static double hist_percentile_ms(const Histogram *h, double p)
+{
+	unsigned long target = (unsigned long)(p / 100.0 * h->count + 0.5);
+	unsigned long seen = 0;
+	for (int b = 0; b < HIST_BUCKETS; b++) {
+		seen += h->buckets[b];
+		if (seen >= target && seen > 0) {
+			int64_t edge = (int64_t)2 << b;
+			return (edge < h->max_us ? edge : h->max_us) / 1000.0;
+		}
+	}
+	return h->max_us / 1000.0;
+}
+
+void stats_enable(int probe)
+{
+	enabled = 1;
+	sync_probe = probe;
+}
+
+int stats_enabled(void)
+{
+	return enabled;
+}
+
+int stats_sync_probe(void)
+{
+	return enabled && sync_probe;
+}
+
+void stats_ws_event(Time server_time)
+{
+	if (!enabled) {
+		return;
+	}
+
+	int64_t now = mono_us();
+	/* server time is in ms since server start, only the drift between events is useful */
+	int64_t offset = now / 1000 - (int64_t)(uint32_t)server_time;
+	if (!have_offset || offset < min_offset_ms) {
+		min_offset_ms = offset;
+		have_offset = 1;
+	}
+
+	/* a burst of switches before the next frame counts from its first event */
+	if (!pending) {
+		pending = 1;
+		drawn = 0;
+		t_event = now;
+		queue_us = (offset - min_offset_ms) * 1000;
+	}
+}
+
+void stats_drawn(void)
+{
+	if (enabled && pending && !drawn) {
+		t_drawn = mono_us();
+		drawn = 1;
+	}
+}
+
+void stats_flushed(void)
+{
+	if (!enabled || !pending || !drawn) {
+		return;
+	}
+
+	int64_t now = mono_us();
+	hist_add(&hists[H_QUEUE], queue_us);
+	hist_add(&hists[H_DRAW], t_drawn - t_event);
+	hist_add(&hists[H_FLUSH], now - t_event);
+	hist_add(&hists[H_TOTAL], queue_us + now - t_event);
+	pending = 0;
+}
+
+void stats_report(FILE *fp)
+{
+	fprintf(fp, "sxbar: workspace switch latency (n=%lu, sync probe %s)\n",
+			hists[H_TOTAL].count, sync_probe ? "on" : "off");
+	fprintf(fp, "  %-6s %9s %9s %9s %9s %9s  (ms)\n", "stage", "min", "mean", "p50", "p99", "max");
+	for (int i = 0; i < H_LAST; i++) {
+		const Histogram *h = &hists[i];
+		if (!h->count) {
+			continue;
+		}
+		fprintf(fp, "  %-6s %9.2f %9.2f %9.2f %9.2f %9.2f\n", h->name,
+				h->min_us / 1000.0, h->sum_us / 1000.0 / h->count,
+				hist_percentile_ms(h, 50), hist_percentile_ms(h, 99), h->max_us / 1000.0);
+	}
+
+	fprintf(fp, "  total histogram:");
+	for (int b = 0; b < HIST_BUCKETS; b++) {
+		if (hists[H_TOTAL].buckets[b]) {
+			fprintf(fp, " <%gms:%lu", ((int64_t)2 << b) / 1000.0, hists[H_TOTAL].buckets[b]);
+		}
+	}
+	fprintf(fp, "\n");
+	fflush(fp);
+}
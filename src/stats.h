@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdio.h>
+#include <X11/Xlib.h>
+
+void stats_enable(int sync_probe);
+int stats_enabled(void);
+int stats_sync_probe(void);
+void stats_ws_event(Time server_time);
+void stats_drawn(void);
+void stats_flushed(void);
+void stats_report(FILE *fp);
@@ -0,0 +1,395 @@
+/*
+ * --stdin mode: status lines from another program fill the module slots. A stream whose
+ * first byte is '{' is the i3bar protocol (a header object, then an endless array of block
+ * arrays; '[' is taken as that array without a header); anything else is plain text, one
+ * update per line. Input is parsed a byte at a time as it arrives, so an update costs only
+ * its own bytes whatever the stream length.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "defs.h"
+#include "modules.h"
+#include "parser.h"
+#include "status.h"
+
+enum { MODE_UNKNOWN, MODE_PLAIN, MODE_JSON };
+enum { KEY_OTHER, KEY_FULL_TEXT, KEY_COLOR };
+
+/* depth of the brackets a block's members sit at: stream array, update array, block */
+#define BLOCK_DEPTH 3
+
+typedef struct Block {
+	char *text;
+	int has_colour;
+	unsigned int rgb;
+} Block;
+
+typedef struct Parser {
+	int mode;
+	int header_done;
+	int depth;
+
+	/* string token being read, with escape state */
+	int in_string;
+	int escape;
+	int uni_left;		/* hex digits of a \u escape still expected */
+	unsigned int uni;
+	unsigned int surrogate;
+	char *str;
+	size_t len;
+	size_t cap;
+
+	/* position inside a block object */
+	int expect_value;
+	int key;
+	Block cur;
+
+	/* blocks of the update being read, then the last complete update */
+	Block *pending;
+	int npending;
+	Block *blocks;
+	int nblocks;
+
+	/* a block's text with its colour markup, copied out by module_set_output() */
+	char *out;
+	size_t out_cap;
+} Parser;
+
+extern Config config;
+
+static int status_in = -1;
+static Parser ps;
+
+static void put_byte(char c)
+{
+	if (ps.len + 1 >= ps.cap) {
+		ps.cap = ps.cap ? ps.cap * 2 : 128;
+		ps.str = realloc(ps.str, ps.cap);
+	}
+	ps.str[ps.len++] = c;
+	ps.str[ps.len] = '\0';
+}
+
+static void put_utf8(unsigned int cp)
+{
+	if (cp < 0x80) {
+		put_byte(cp);
+	}
+	else if (cp < 0x800) {
+		put_byte(0xc0 | cp >> 6);
+		put_byte(0x80 | (cp & 0x3f));
+	}
+	else if (cp < 0x10000) {
+		put_byte(0xe0 | cp >> 12);
+		put_byte(0x80 | ((cp >> 6) & 0x3f));
+		put_byte(0x80 | (cp & 0x3f));
+	}
+	else {
+		put_byte(0xf0 | cp >> 18);
+		put_byte(0x80 | ((cp >> 12) & 0x3f));
+		put_byte(0x80 | ((cp >> 6) & 0x3f));
+		put_byte(0x80 | (cp & 0x3f));
+	}
+}
+
+static void free_blocks(Block *blocks, int n)
+{
+	for (int i = 0; i < n; i++) {
+		free(blocks[i].text);
+	}
+	free(blocks);
+}
+
+/* blocks become module outputs, a colour becomes leading ^fg() markup */
+static int apply_blocks(void)
+{
+	int changed = False;
+	for (int i = 0; i < ps.nblocks; i++) {
+		Module *m = module_slot(&config, i);
+		if (!m) {
+			break;
+		}
+		m->type = MODULE_STDIN;
+		m->enabled = True;
+
+		const Block *b = &ps.blocks[i];
+		size_t len = strlen(b->text) + sizeof "^fg(#rrggbb)";
+		if (len > ps.out_cap) {
+			ps.out_cap = len * 2;
+			ps.out = realloc(ps.out, ps.out_cap);
+		}
+		if (b->has_colour) {
+			snprintf(ps.out, len, "^fg(#%06x)%s", b->rgb, b->text);
+		}
+		else {
+			snprintf(ps.out, len, "%s", b->text);
+		}
+		changed |= module_set_output(m, ps.out);
+	}
+	/* slots the stream no longer fills disappear */
+	for (int i = ps.nblocks; i < config.module_count; i++) {
+		Module *m = &config.modules[i];
+		if (m->cached_output) {
+			module_set_output(m, NULL);
+			changed = True;
+		}
+	}
+	return changed;
+}
+
+static int commit_update(void)
+{
+	free_blocks(ps.blocks, ps.nblocks);
+	ps.blocks = ps.pending;
+	ps.nblocks = ps.npending;
+	ps.pending = NULL;
+	ps.npending = 0;
+	return apply_blocks();
+}
+
+static int parse_colour(const char *s, unsigned int *rgb)
+{
+	if (s[0] != '#' || strlen(s) < 7 || strspn(s + 1, "0123456789abcdefABCDEF") < 6) {
+		return 0;
+	}
+	char hex[7];
+	memcpy(hex, s + 1, 6);
+	hex[6] = '\0';
+	*rgb = strtoul(hex, NULL, 16);
+	return 1;
+}
+
+static void end_string(void)
+{
+	ps.in_string = False;
+	if (!ps.header_done || ps.depth != BLOCK_DEPTH) {
+		return;
+	}
+	if (!ps.expect_value) {
+		ps.key = !strcmp(ps.str ? ps.str : "", "full_text") ? KEY_FULL_TEXT
+			: !strcmp(ps.str ? ps.str : "", "color") ? KEY_COLOR : KEY_OTHER;
+		return;
+	}
+	if (ps.key == KEY_FULL_TEXT) {
+		free(ps.cur.text);
+		ps.cur.text = strdup(ps.str ? ps.str : "");
+	}
+	else if (ps.key == KEY_COLOR) {
+		ps.cur.has_colour = parse_colour(ps.str ? ps.str : "", &ps.cur.rgb);
+	}
+}
+
+static void string_byte(char c)
+{
+	if (ps.uni_left) {
+		int d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10
+			: c >= 'A' && c <= 'F' ? c - 'A' + 10 : 0;
+		ps.uni = ps.uni << 4 | d;
+		if (--ps.uni_left) {
+			return;
+		}
+		if (ps.uni >= 0xd800 && ps.uni < 0xdc00) {
+			ps.surrogate = ps.uni;
+		}
+		else if (ps.uni >= 0xdc00 && ps.uni < 0xe000 && ps.surrogate) {
+			put_utf8(0x10000 + ((ps.surrogate - 0xd800) << 10) + (ps.uni - 0xdc00));
+			ps.surrogate = 0;
+		}
+		else {
+			put_utf8(ps.uni);
+		}
+		return;
+	}
+	if (ps.escape) {
+		ps.escape = False;
+		switch (c) {
+			case 'n': put_byte('\n'); break;
+			case 't': put_byte('\t'); break;
+			case 'r': put_byte('\r'); break;
+			case 'b': put_byte('\b'); break;
+			case 'f': put_byte('\f'); break;
+			case 'u': ps.uni_left = 4; ps.uni = 0; break;
+			default: put_byte(c); break;
+		}
+		return;
+	}
+	if (c == '\\') {
+		ps.escape = True;
+	}
+	else if (c == '"') {
+		end_string();
+	}
+	else {
+		put_byte(c);
+	}
+}
+
+/* feed one byte of the i3bar stream, returns true when a completed update changed output */
+static int json_byte(char c)
+{
+	if (ps.in_string) {
+		string_byte(c);
+		return False;
+	}
+
+	switch (c) {
+		case '"':
+			ps.in_string = True;
+			ps.len = 0;
+			if (ps.str) {
+				ps.str[0] = '\0';
+			}
+			break;
+		case '{':
+		case '[':
+			ps.depth++;
+			if (ps.header_done && ps.depth == BLOCK_DEPTH - 1 && c == '[') {
+				free_blocks(ps.pending, ps.npending);
+				ps.pending = NULL;
+				ps.npending = 0;
+			}
+			else if (ps.header_done && ps.depth == BLOCK_DEPTH && c == '{') {
+				memset(&ps.cur, 0, sizeof ps.cur);
+				ps.expect_value = False;
+			}
+			break;
+		case '}':
+		case ']':
+			if (ps.depth > 0) {
+				ps.depth--;
+			}
+			if (!ps.header_done) {
+				/* the header object closed, the endless array follows */
+				ps.header_done = ps.depth == 0;
+			}
+			else if (ps.depth == BLOCK_DEPTH - 1 && c == '}') {
+				/* a config holds no more modules than that, neither does a stream */
+				if (ps.npending >= MAX_MODULES) {
+					free(ps.cur.text);
+				}
+				else {
+					ps.pending = realloc(ps.pending, (ps.npending + 1) * sizeof *ps.pending);
+					if (!ps.cur.text) {
+						ps.cur.text = strdup("");
+					}
+					ps.pending[ps.npending++] = ps.cur;
+				}
+				memset(&ps.cur, 0, sizeof ps.cur);
+			}
+			else if (ps.depth == BLOCK_DEPTH - 2 && c == ']') {
+				return commit_update();
+			}
+			break;
+		case ':':
+			ps.expect_value = True;
+			break;
+		case ',':
+			if (ps.depth == BLOCK_DEPTH) {
+				ps.expect_value = False;
+			}
+			break;
+		default:
+			/* numbers, true/false/null and whitespace carry nothing we draw */
+			break;
+	}
+	return False;
+}
+
+int status_open(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		return -1;
+	}
+	status_in = fd;
+	status_apply();
+	return fd;
+}
+
+int status_fd(void)
+{
+	return status_in;
+}
+
+/* read what is available without blocking, returns true if any module output changed */
+int status_read(void)
+{
+	char buf[4096];
+	int changed = False;
+
+	while (status_in >= 0) {
+		ssize_t n = read(status_in, buf, sizeof buf);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n == 0) {
+			/* the generator exited, leave its last update on the bar */
+			close(status_in);
+			status_in = -1;
+			break;
+		}
+		if (n < 0) {
+			break;
+		}
+
+		for (ssize_t i = 0; i < n; i++) {
+			char c = buf[i];
+			if (ps.mode == MODE_UNKNOWN) {
+				if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+					continue;
+				}
+				ps.mode = c == '{' || c == '[' ? MODE_JSON : MODE_PLAIN;
+				/* some generators skip the header and open the endless array right away */
+				ps.header_done = c == '[';
+			}
+			if (ps.mode == MODE_JSON) {
+				changed |= json_byte(c);
+			}
+			else if (c != '\n') {
+				put_byte(c);
+			}
+			else {
+				/* a plain line is a single block */
+				free_blocks(ps.pending, ps.npending);
+				ps.pending = malloc(sizeof *ps.pending);
+				ps.pending[0] = (Block){strdup(ps.str ? ps.str : ""), False, 0};
+				ps.npending = 1;
+				ps.len = 0;
+				if (ps.str) {
+					ps.str[0] = '\0';
+				}
+				changed |= commit_update();
+			}
+		}
+	}
+	return changed;
+}
+
+/* hand every module slot to the stream, again after a reload replaced the modules */
+void status_apply(void)
+{
+	for (int i = 0; i < config.module_count; i++) {
+		config.modules[i].type = MODULE_STDIN;
+	}
+	apply_blocks();
+}
+
+void status_close(void)
+{
+	if (status_in >= 0) {
+		close(status_in);
+		status_in = -1;
+	}
+	free_blocks(ps.pending, ps.npending);
+	free_blocks(ps.blocks, ps.nblocks);
+	free(ps.cur.text);
+	free(ps.str);
+	free(ps.out);
+	memset(&ps, 0, sizeof ps);
+}
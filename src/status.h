@@ -0,0 +1,7 @@
+#pragma once
+
+int status_open(int fd);
+int status_fd(void);
+int status_read(void);
+void status_apply(void);
+void status_close(void);
@@ -1,5 +1,9 @@
 #define _POSIX_C_SOURCE 200809L
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,34 +15,128 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/extensions/Xinerama.h>
+#include <X11/extensions/Xrandr.h>
 #include <X11/Xft/Xft.h>
 
 #include "defs.h"
 #include "modules.h"
 
+/* interned once in open_display(), compared against on every PropertyNotify */
+enum {
+	NET_ACTIVE_WINDOW,
+	NET_CURRENT_DESKTOP,
+	NET_DESKTOP_NAMES,
+	NET_WM_NAME,
+	NET_WM_STRUT_PARTIAL,
+	NET_WM_WINDOW_TYPE,
+	NET_WM_WINDOW_TYPE_DOCK,
+	UTF8_STRING,
+	ATOM_LAST
+};
+
+/* state that changed since the last frame, flushed once per event batch */
+#define DIRTY_WS_CURRENT	(1 << 0)
+#define DIRTY_WS_NAMES		(1 << 1)
+#define DIRTY_BARS			(1 << 2)
+#define DIRTY_ACTIVE		(1 << 3)
+#define DIRTY_TITLE			(1 << 4)
+
+/* blank space between the end of scrolling text and its next repetition */
+#define MARQUEE_GAP 40
+
+int alloc_col(const char *hex, unsigned long *pixel);
+void alloc_colours(void);
+void bar_geometry(const XineramaScreenInfo *m, int *x, int *y, int *w, int *h);
+int check_config(const char *path);
 void cleanup_resources(void);
+void create_bar(int i);
 void create_bars(void);
 void draw_bar_into(Drawable draw, int monitor_index);
+XftDraw *draw_begin(Drawable draw, int monitor_index, int w, int h);
+void draw_end(Drawable draw, XftDraw *xd, int w, int h);
+void draw_module(Drawable draw, XftDraw *xd, Module *m, int x, int h);
+void draw_text(XftDraw *xd, const XftColor *col, int x, int y, const char *s);
+void fill_rect(Drawable draw, unsigned long pixel, int x, int y, int w, int h);
 void redraw_monitor(int monitor_index);
+void redraw_all(void);
+int redraw_module_slots(void);
+void free_colours(void);
+void free_fonts(void);
+void free_strips(Config *cfg);
 int find_window_monitor(Window win);
+Window get_active_window(void);
 int get_current_workspace(void);
 char **get_workspace_name(int *count);
+char *get_window_title(Window w);
+void add_segment(int monitor_index, int x, int y, int w, int h, int workspace, int module);
+void hdl_button(XEvent *xev);
 void hdl_dummy(XEvent *xev);
 void hdl_expose(XEvent *xev);
 void hdl_property(XEvent *xev);
-void init_defaults(void);
+void init_defaults(Config *cfg);
+void load_config(void);
+void load_fonts(void);
+int marquee_active(void);
+int marquee_scrolls(const Module *m);
+void marquee_tick(void);
+void module_layout(Module *m);
+void module_strip(Module *m, int h);
+int module_slot_width(const Module *m);
+void open_display(void);
 unsigned long parse_col(const char *hex);
+XineramaScreenInfo *parse_layout(const char *s, int *count);
+XineramaScreenInfo *query_monitors(int *count);
+int find_primary_monitor(void);
+int pointer_monitor(void);
+int module_on_monitor(const Module *m, int monitor_index);
+int module_shown(const Module *m);
+int bar_workspace(int monitor_index);
+void record_event(const XEvent *xev);
+void record_layout(void);
+void reload_config(void);
+int replay_due(int *monitors_changed);
 void run(void);
+const Segment *segment_at(int monitor_index, int x, int y);
+void set_bar_strut(Window win, int x, int y, int w, int h);
 void setup(void);
-int xft_center_x(const char *s, int area_w, XftFont *f);
+void sigchld(int sig);
+void sighup(int sig);
+void sigusr1(int sig);
+void sigusr2(int sig);
+void static_config(Config *cfg);
+void switch_workspace(int index, Time when);
+int xerror(Display *d, XErrorEvent *ee);
+void update_active_window(unsigned int what);
+void update_monitors(void);
+void update_workspaces(unsigned int what);
 int xft_text_width(const char *s);
-int xft_text_adv_v(const char *s);
 
+#ifdef SXBAR_XCB
+#include "backend_xcb.h"
+#endif
+#include "atlas.h"
+#include "bench.h"
+#ifdef SXBAR_CLIENT_RENDER
+#include "canvas.h"
+#endif
+#include "fonts.h"
+#include "markup.h"
+#include "memreport.h"
 #include "parser.h"
+#include "stats.h"
+#include "status.h"
+#include "trace.h"
+
+#ifdef SXBAR_STATIC_CONFIG
+/* CONFIG=static: settings come from config.h, BAR_POSITION makes the layout branches constant */
+#include "config.h"
+#else
+#define BAR_POSITION config.bar_position
+#endif
 
 EventHandler evtable[LASTEvent];
 XftFont *font;
-XftFont *font_rotated = NULL;
+Atlas *atlas = NULL;
 Display *dpy;
 Window root;
 Window *windows = NULL;
@@ -47,13 +145,102 @@ GC gc;
 Config config;
 Pixmap *buffers = NULL;
 int n_monitors = 0;
+int randr_event_base = -1;
+Atom atoms[ATOM_LAST];
+unsigned int dirty = 0;
+volatile sig_atomic_t reload_pending = 0;
+volatile sig_atomic_t report_pending = 0;
+volatile sig_atomic_t mem_report_pending = 0;
+/* SIGCHLD writes a byte here, poll() sees it however late in the loop a child exited */
+int child_pipe[2] = {-1, -1};
 int scr;
 XftColor xft_fg, xft_bg;
 XftColor xft_ws_inactive_fg;
 XftColor xft_ws_active_fg;
 
+/* workspace state, refreshed from root window properties */
+int ws_current = -1;
+char **ws_names = NULL;
+int ws_name_count = 0;
+
+/* workspaces.per_monitor: desktop last switched to on each monitor, -1 while it has none */
+int ws_monitor[MAX_MONITORS];
+
+/* bars the next redraw_all() repaints, a bit per monitor index */
+unsigned int redraw_mask = ~0u;
+
+/* monitor index of the RandR primary output, for modules shown on the primary bar */
+int primary_monitor = 0;
+
+/* focused client, watched for title changes while a window_title module is enabled */
+Window active_win = None;
+int (*xerrorxlib)(Display *, XErrorEvent *);
+
+/* --stdin: module slots are filled from a status generator piped into us */
+int stdin_mode = False;
+
+/* --mem-report: memory use after the first frame and on every SIGUSR2 */
+int mem_report_on = False;
+
+/* area of the last drawn frame that differs from what its buffer held before */
+XRectangle bar_damage;
+
+/* what each bar showed where at its last full layout, clicks are looked up in here */
+Segment *segments[MAX_MONITORS];
+int segment_count[MAX_MONITORS];
+int segment_cap[MAX_MONITORS];
+
+#ifdef SXBAR_CLIENT_RENDER
+/* RENDER=client: a canvas per monitor for horizontal bars, the one being drawn in canvas */
+int client_render = False;
+Canvas **canvases = NULL;
+Canvas *canvas = NULL;
+
+Canvas *canvas_for(int monitor_index, int w, int h);
+void free_canvases(void);
+#endif
+
+/* --replay: monitors as recorded, and the window whose title stands in for the focused one */
+XineramaScreenInfo *replay_layout = NULL;
+int replay_layout_count = 0;
+Window replay_win = None;
+
+/* set by --config, otherwise resolved by get_config_path() */
+char *config_path = NULL;
+
+#ifndef SXBAR_STATIC_CONFIG
+int check_config(const char *path)
+{
+	/* a display is only needed to resolve colour names */
+	dpy = XOpenDisplay(NULL);
+	if (dpy) {
+		scr = DefaultScreen(dpy);
+	}
+
+	Config cfg;
+	init_defaults(&cfg);
+	char *cfgpath = path ? strdup(path) : get_config_path();
+	int errors = parse_config(cfgpath, &cfg);
+	if (errors == 0) {
+		printf("%s: ok, %d module(s)\n", cfgpath, cfg.module_count);
+	}
+	else if (errors > 0) {
+		printf("%s: %d error(s)\n", cfgpath, errors);
+	}
+	free(cfgpath);
+	free_config(&cfg);
+	if (dpy) {
+		XCloseDisplay(dpy);
+	}
+	return errors == 0 ? 0 : 1;
+}
+#endif
+
 void cleanup_resources(void)
 {
+#ifdef SXBAR_CLIENT_RENDER
+	free_canvases();
+#endif
 	if (buffers) {
 		for (int i = 0; i < n_monitors; i++) {
 			XFreePixmap(dpy, buffers[i]);
@@ -66,22 +253,15 @@ void cleanup_resources(void)
 		}
 		free(windows);
 	}
-	if (monitors) {
-		XFree(monitors);
-	}
+	free(monitors);
 
-	if (font_rotated && font_rotated != font) {
-		XftFontClose(dpy, font_rotated);
-	}
-	if (font) {
-		XftFontClose(dpy, font);
+	if (dpy) {
+		free_strips(&config);
 	}
-
+	free_fonts();
 	if (dpy) {
-		XftColorFree(dpy, DefaultVisual(dpy, scr), DefaultColormap(dpy, scr), &xft_fg);
-		XftColorFree(dpy, DefaultVisual(dpy, scr), DefaultColormap(dpy, scr), &xft_bg);
-		XftColorFree(dpy, DefaultVisual(dpy, scr), DefaultColormap(dpy, scr), &xft_ws_inactive_fg);
-		XftColorFree(dpy, DefaultVisual(dpy, scr), DefaultColormap(dpy, scr), &xft_ws_active_fg);
+		free_colours();
+		markup_colours_free(dpy, scr);
 	}
 	if (gc) {
 		XFreeGC(dpy, gc);
@@ -89,223 +269,189 @@ void cleanup_resources(void)
 	if (dpy) {
 		XCloseDisplay(dpy);
 	}
-	/* free workspace labels */
-	if (config.ws_labels) {
-		for (int i = 0; i < config.ws_label_count; i++) {
-			free(config.ws_labels[i]);
+	modules_watch_close();
+	modules_actions_free();
+	for (int i = 0; i < 2; i++) {
+		if (child_pipe[i] >= 0) {
+			close(child_pipe[i]);
+			child_pipe[i] = -1;
 		}
-		free(config.ws_labels);
 	}
+	status_close();
+	for (int i = 0; i < MAX_MONITORS; i++) {
+		free(segments[i]);
+		segments[i] = NULL;
+		segment_count[i] = segment_cap[i] = 0;
+	}
+	free_config(&config);
+	free(config_path);
+	free(ws_names);
 }
 
-void create_bars(void)
+int alloc_col(const char *hex, unsigned long *pixel)
 {
-	int xinerama_active = 0;
-	if (XineramaIsActive(dpy)) {
-		monitors = XineramaQueryScreens(dpy, &n_monitors);
-		xinerama_active = 1;
-	}
-	if (!xinerama_active || n_monitors <= 0) {
-		n_monitors = 1;
-		monitors = malloc(sizeof *monitors);
-		monitors[0].screen_number = 0;
-		monitors[0].x_org = 0;
-		monitors[0].y_org = 0;
-		monitors[0].width = DisplayWidth(dpy, scr);
-		monitors[0].height = DisplayHeight(dpy, scr);
-	}
-
-	windows = malloc(n_monitors * sizeof *windows);
-	buffers = malloc(n_monitors * sizeof *buffers);
+	XColor col;
 
-	for (int i = 0; i < n_monitors; i++) {
-		int bw = config.border ? config.border_width : 0;
+	if (!dpy) {
+		/* --check-config without a display: names can't be resolved, check #rgb syntax */
+		size_t n = strlen(hex);
+		*pixel = 0;
+		return hex[0] != '#' || ((n == 4 || n == 7 || n == 10 || n == 13) &&
+				strspn(hex + 1, "0123456789abcdefABCDEF") == n - 1);
+	}
 
-		int w = 0, h = 0, x = 0, y = 0;
-		switch (config.bar_position) {
-			case BAR_POS_TOP:
-				w = monitors[i].width - (2 * config.horizontal_padding) - (2 * bw);
-				h = config.height;
-				x = monitors[i].x_org + config.horizontal_padding;
-				y = monitors[i].y_org + config.vertical_padding;
-				break;
-			case BAR_POS_BOTTOM:
-				w = monitors[i].width - (2 * config.horizontal_padding) - (2 * bw);
-				h = config.height;
-				x = monitors[i].x_org + config.horizontal_padding;
-				y = monitors[i].y_org + monitors[i].height - h - config.vertical_padding - bw;
-				break;
-			case BAR_POS_LEFT:
-				w = config.height;
-				h = monitors[i].height - (2 * config.vertical_padding) - (2 * bw);
-				x = monitors[i].x_org + config.horizontal_padding;
-				y = monitors[i].y_org + config.vertical_padding;
-				break;
-			case BAR_POS_RIGHT:
-				w = config.height;
-				h = monitors[i].height - (2 * config.vertical_padding) - (2 * bw);
-				x = monitors[i].x_org + monitors[i].width - w - config.horizontal_padding - bw;
-				y = monitors[i].y_org + config.vertical_padding;
-				break;
-			default: /* fallback to bottom */
-				w = monitors[i].width - (2 * config.horizontal_padding) - (2 * bw);
-				h = config.height;
-				x = monitors[i].x_org + config.horizontal_padding;
-				y = monitors[i].y_org + monitors[i].height - h - config.vertical_padding - bw;
-				break;
-		}
+	Colormap cmap = DefaultColormap(dpy, scr);
+	if (!XParseColor(dpy, cmap, hex, &col) || !XAllocColor(dpy, cmap, &col)) {
+		return 0;
+	}
+	*pixel = col.pixel;
+	return 1;
+}
 
-		XSetWindowAttributes wa = {
-			.background_pixel = config.background_colour,
-			.border_pixel = config.border_colour,
-			.event_mask = ExposureMask | ButtonPressMask
+void alloc_colours(void)
+{
+	Colormap cmap = DefaultColormap(dpy, scr);
+	XftColor *dst[] = {&xft_fg, &xft_bg, &xft_ws_inactive_fg, &xft_ws_active_fg};
+	const char *what[] = {"fg", "bg", "ws inactive fg", "ws active fg"};
+	XColor xcolours[] = {
+		{.pixel = config.foreground_colour},
+		{.pixel = config.background_colour},
+		{.pixel = config.ws_inactive_fg},
+		{.pixel = config.ws_active_fg},
+	};
+	int n = sizeof xcolours / sizeof *xcolours;
+
+	/* a single QueryColors request instead of one round-trip per colour */
+	XQueryColors(dpy, cmap, xcolours, n);
+	for (int i = 0; i < n; i++) {
+		XRenderColor render_colour = {
+			.red = xcolours[i].red,
+			.green = xcolours[i].green,
+			.blue = xcolours[i].blue,
+			.alpha = 0xffff,
 		};
-
-		windows[i] = XCreateWindow(
-				dpy, root, x, y, w, h, bw, CopyFromParent, InputOutput,
-				DefaultVisual(dpy, scr),
-				CWBackPixel | CWBorderPixel | CWEventMask, &wa
-				);
-
-		XStoreName(dpy, windows[i], "sxbar");
-		char res_name[] = "sxbar";
-		char res_class[] = "sxbar";
-		XClassHint ch = {res_name, res_class};
-		XSetClassHint(dpy, windows[i], &ch);
-
-		Atom A_WM_TYPE = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False);
-		Atom A_WM_TYPE_DOCK = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DOCK", False);
-		XChangeProperty(
-				dpy, windows[i], A_WM_TYPE, XA_ATOM, 32, PropModeReplace,
-				(unsigned char *)&A_WM_TYPE_DOCK, 1
-				);
-
-		Atom A_STRUT = XInternAtom(dpy, "_NET_WM_STRUT_PARTIAL", False);
-		long strut[12] = {0};
-		switch (config.bar_position) {
-			case BAR_POS_BOTTOM:
-				strut[3] = h + bw + config.vertical_padding;
-				strut[10] = x;
-				strut[11] = x + w + 2 * bw - 1;
-				break;
-			case BAR_POS_TOP:
-				strut[2] = y + h + bw;
-				strut[8] = x;
-				strut[9] = x + w + 2 * bw - 1;
-				break;
-			case BAR_POS_LEFT:
-				strut[0] = w + bw + config.horizontal_padding;
-				strut[4] = y;
-				strut[5] = y + h + 2 * bw - 1;
-				break;
-			case BAR_POS_RIGHT:
-				strut[1] = w + bw + config.horizontal_padding;
-				strut[6] = y;
-				strut[7] = y + h + 2 * bw - 1;
-				break;
-			default: /* fallback to bottom */
-				strut[3] = h + bw + config.vertical_padding;
-				strut[10] = x;
-				strut[11] = x + w + 2 * bw - 1;
-				break;
+		if (!XftColorAllocValue(dpy, DefaultVisual(dpy, scr), cmap, &render_colour, dst[i])) {
+			errx(1, "could not alloc xft %s", what[i]);
 		}
-		XChangeProperty(
-				dpy, windows[i], A_STRUT, XA_CARDINAL, 32, PropModeReplace,
-				(unsigned char *)strut, 12
-				);
-
-		buffers[i] = XCreatePixmap(dpy, windows[i], w, h, DefaultDepth(dpy, scr));
-		XMapRaised(dpy, windows[i]);
 	}
+}
 
-	gc = XCreateGC(dpy, windows[0], 0, NULL);
-	XSetForeground(dpy, gc, config.foreground_colour);
-	font = NULL;
-	if (config.font_size > 0) {
-		char spec[256];
-		snprintf(spec, sizeof spec, "%s:pixelsize=%d", config.font, config.font_size);
-		font = XftFontOpenName(dpy, scr, spec);
-	}
-	if (!font) {
-		font = XftFontOpenName(dpy, scr, config.font);
-	}
-	if (!font) {
-		errx(1, "could not load font %s (size %d)", config.font, config.font_size);
+void bar_geometry(const XineramaScreenInfo *m, int *x, int *y, int *w, int *h)
+{
+	int bw = config.border ? config.border_width : 0;
+
+	switch (BAR_POSITION) {
+		case BAR_POS_TOP:
+			*w = m->width - (2 * config.horizontal_padding) - (2 * bw);
+			*h = config.height;
+			*x = m->x_org + config.horizontal_padding;
+			*y = m->y_org + config.vertical_padding;
+			break;
+		case BAR_POS_BOTTOM:
+			*w = m->width - (2 * config.horizontal_padding) - (2 * bw);
+			*h = config.height;
+			*x = m->x_org + config.horizontal_padding;
+			*y = m->y_org + m->height - *h - config.vertical_padding - bw;
+			break;
+		case BAR_POS_LEFT:
+			*w = config.height;
+			*h = m->height - (2 * config.vertical_padding) - (2 * bw);
+			*x = m->x_org + config.horizontal_padding;
+			*y = m->y_org + config.vertical_padding;
+			break;
+		case BAR_POS_RIGHT:
+			*w = config.height;
+			*h = m->height - (2 * config.vertical_padding) - (2 * bw);
+			*x = m->x_org + m->width - *w - config.horizontal_padding - bw;
+			*y = m->y_org + config.vertical_padding;
+			break;
+		default: /* fallback to bottom */
+			*w = m->width - (2 * config.horizontal_padding) - (2 * bw);
+			*h = config.height;
+			*x = m->x_org + config.horizontal_padding;
+			*y = m->y_org + m->height - *h - config.vertical_padding - bw;
+			break;
 	}
+}
 
-	/* create rotated font for vertical bars */
-	if (config.bar_position == BAR_POS_LEFT || config.bar_position == BAR_POS_RIGHT) {
-		FcPattern *pat = FcPatternDuplicate(font->pattern);
-		if (pat) {
-			FcMatrix rot = (FcMatrix){0, 1, -1, 0}; /* 90 deg clockwise */
-			FcPatternAddMatrix(pat, FC_MATRIX, &rot);
-			FcConfigSubstitute(NULL, pat, FcMatchPattern);
-			XftDefaultSubstitute(dpy, scr, pat);
-			XftFont *rf = XftFontOpenPattern(dpy, pat);
-			if (rf) {
-				font_rotated = rf;
-				pat = NULL; /* Xft now owns pattern */
-			}
-			if (pat) {
-				FcPatternDestroy(pat);
-			}
-		}
-		if (!font_rotated) {
-			font_rotated = font; /* fallback */
-		}
+#ifdef SXBAR_CLIENT_RENDER
+/* monitor i's canvas, replaced when the bar changed size */
+Canvas *canvas_for(int i, int w, int h)
+{
+	if (!canvases) {
+		canvases = calloc(n_monitors, sizeof *canvases);
 	}
+	if (!canvas_fits(canvases[i], w, h)) {
+		canvas_free(canvases[i]);
+		canvases[i] = canvas_new(dpy, scr, w, h);
+	}
+	return canvases[i];
+}
+#endif
 
-	{
-		Colormap cmap = DefaultColormap(dpy, scr);
-		XColor xcolour;
-		XRenderColor render_colour;
-
-		xcolour.pixel = config.foreground_colour;
-		XQueryColor(dpy, cmap, &xcolour);
-		render_colour.red = xcolour.red;
-		render_colour.green = xcolour.green;
-		render_colour.blue = xcolour.blue;
-		render_colour.alpha = 0xffff;
-		if (!XftColorAllocValue(dpy, DefaultVisual(dpy, scr), cmap, &render_colour, &xft_fg)) {
-			errx(1, "could not alloc xft fg");
-		}
+void create_bar(int i)
+{
+	int bw = config.border ? config.border_width : 0;
+	int x, y, w, h;
+	bar_geometry(&monitors[i], &x, &y, &w, &h);
+
+#ifdef SXBAR_XCB
+	windows[i] = backend_create_window(root, x, y, w, h, bw,
+			config.background_colour, config.border_colour, ExposureMask | ButtonPressMask,
+			atoms[NET_WM_WINDOW_TYPE], atoms[NET_WM_WINDOW_TYPE_DOCK]);
+#else
+	XSetWindowAttributes wa = {
+		.background_pixel = config.background_colour,
+		.border_pixel = config.border_colour,
+		.event_mask = ExposureMask | ButtonPressMask
+	};
+
+	windows[i] = XCreateWindow(
+			dpy, root, x, y, w, h, bw, CopyFromParent, InputOutput,
+			DefaultVisual(dpy, scr),
+			CWBackPixel | CWBorderPixel | CWEventMask, &wa
+			);
+
+	XStoreName(dpy, windows[i], "sxbar");
+	char res_name[] = "sxbar";
+	char res_class[] = "sxbar";
+	XClassHint ch = {res_name, res_class};
+	XSetClassHint(dpy, windows[i], &ch);
+
+	XChangeProperty(
+			dpy, windows[i], atoms[NET_WM_WINDOW_TYPE], XA_ATOM, 32, PropModeReplace,
+			(unsigned char *)&atoms[NET_WM_WINDOW_TYPE_DOCK], 1
+			);
+#endif
+
+	set_bar_strut(windows[i], x, y, w, h);
+
+	buffers[i] = XCreatePixmap(dpy, windows[i], w, h, DefaultDepth(dpy, scr));
+	XMapRaised(dpy, windows[i]);
+}
 
-		xcolour.pixel = config.background_colour;
-		XQueryColor(dpy, cmap, &xcolour);
-		render_colour.red = xcolour.red;
-		render_colour.green = xcolour.green;
-		render_colour.blue = xcolour.blue;
-		render_colour.alpha = 0xffff;
-		if (!XftColorAllocValue(dpy, DefaultVisual(dpy, scr), cmap, &render_colour, &xft_bg)) {
-			errx(1, "could not alloc xft bg");
-		}
+void create_bars(void)
+{
+	monitors = query_monitors(&n_monitors);
+	primary_monitor = find_primary_monitor();
 
-		xcolour.pixel = config.ws_inactive_fg;
-		XQueryColor(dpy, cmap, &xcolour);
-		render_colour.red = xcolour.red;
-		render_colour.green = xcolour.green;
-		render_colour.blue = xcolour.blue;
-		render_colour.alpha = 0xffff;
-		if (!XftColorAllocValue(dpy, DefaultVisual(dpy, scr), cmap, &render_colour, &xft_ws_inactive_fg)) {
-			errx(1, "could not alloc xft ws inactive fg");
-		}
+	windows = malloc(n_monitors * sizeof *windows);
+	buffers = malloc(n_monitors * sizeof *buffers);
 
-		xcolour.pixel = config.ws_active_fg;
-		XQueryColor(dpy, cmap, &xcolour);
-		render_colour.red = xcolour.red;
-		render_colour.green = xcolour.green;
-		render_colour.blue = xcolour.blue;
-		render_colour.alpha = 0xffff;
-		if (!XftColorAllocValue(dpy, DefaultVisual(dpy, scr), cmap, &render_colour, &xft_ws_active_fg)) {
-			errx(1, "could not alloc xft ws active fg");
-		}
+	for (int i = 0; i < n_monitors; i++) {
+		create_bar(i);
 	}
+
+	gc = XCreateGC(dpy, windows[0], 0, NULL);
+	XSetForeground(dpy, gc, config.foreground_colour);
+	load_fonts();
+	alloc_colours();
 }
 
 void draw_bar_into(Drawable draw, int monitor_index)
 {
 	int w, h;
-	if (config.bar_position == BAR_POS_LEFT || config.bar_position == BAR_POS_RIGHT) {
+	if (IS_VERTICAL(BAR_POSITION)) {
 		int bw = config.border ? config.border_width : 0;
 		w = config.height;
 		h = monitors[monitor_index].height - 2 * config.vertical_padding - 2 * bw;
@@ -316,17 +462,14 @@ void draw_bar_into(Drawable draw, int monitor_index)
 		h = config.height;
 	}
 
-	XSetForeground(dpy, gc, config.background_colour);
-	XFillRectangle(dpy, draw, gc, 0, 0, w, h);
-	XftDraw *xd = XftDrawCreate(dpy, draw, DefaultVisual(dpy, scr), DefaultColormap(dpy, scr));
+	XftDraw *xd = draw_begin(draw, monitor_index, w, h);
+	fill_rect(draw, config.background_colour, 0, 0, w, h);
+	segment_count[monitor_index] = 0;
 
 	/* vertical bar special path */
-	if (config.bar_position == BAR_POS_LEFT || config.bar_position == BAR_POS_RIGHT) {
-		XftFont *vf = font_rotated ? font_rotated : font;
-
-		int current_ws = get_current_workspace();
-		int name_count = 0;
-		char **names = get_workspace_name(&name_count);
+	if (IS_VERTICAL(BAR_POSITION)) {
+		Picture dst = XftDrawPicture(xd);
+		int current_ws = bar_workspace(monitor_index);
 
 		char **labels = NULL;
 		int label_count = 0;
@@ -334,25 +477,35 @@ void draw_bar_into(Drawable draw, int monitor_index)
 			labels = config.ws_labels;
 			label_count = config.ws_label_count;
 		}
-		else if (names) {
-			labels = names;
-			label_count = name_count;
+		else if (ws_names) {
+			labels = ws_names;
+			label_count = ws_name_count;
+		}
+
+		/* rotated glyphs span [-descent, ascent] across the bar, centre that */
+		int avail = w - 2 * config.text_padding;
+		int pen_x = config.text_padding + (avail - font->ascent - font->descent) / 2 + font->descent;
+		if (pen_x < font->descent) {
+			pen_x = font->descent;
 		}
 
 		/* measure modules total vertical advance */
 		int modules_total_adv = 0;
 		for (int i = 0; i < config.module_count; i++) {
-			if (!config.modules[i].enabled || !config.modules[i].cached_output) {
+			Module *m = &config.modules[i];
+			if (!m->enabled || !m->cached_output || !module_on_monitor(m, monitor_index)) {
 				continue;
 			}
-			modules_total_adv += xft_text_adv_v(config.modules[i].cached_output) + 20;
+			module_layout(m);
+			modules_total_adv += m->width + 20;
 		}
 
 		int ws_segment_adv = 0;
+		int *ws_adv = labels ? malloc(label_count * sizeof *ws_adv) : NULL;
 		if (labels) {
 			for (int i = 0; i < label_count; i++) {
-				int adv = xft_text_adv_v(labels[i]);
-				ws_segment_adv += adv + config.ws_pad_left + config.ws_pad_right;
+				ws_adv[i] = atlas_advance(atlas, labels[i], True);
+				ws_segment_adv += ws_adv[i] + config.ws_pad_left + config.ws_pad_right;
 				if (i + 1 < label_count) {
 					ws_segment_adv += config.ws_spacing;
 				}
@@ -377,58 +530,84 @@ void draw_bar_into(Drawable draw, int monitor_index)
 				break;
 		}
 
-		/* workspaces */
+		/* workspaces: backgrounds first, then one composite per text colour */
 		if (labels) {
+			AtlasRun *runs = malloc(label_count * sizeof *runs);
+			int n_inactive = 0;
+			AtlasRun active = {0};
 			int cur_y = ws_start_y;
 			for (int i = 0; i < label_count; i++) {
-				const char *txt = labels[i];
-				int adv = xft_text_adv_v(txt);
-				int box_adv = adv + config.ws_pad_left + config.ws_pad_right;
+				int box_adv = ws_adv[i] + config.ws_pad_left + config.ws_pad_right;
 
-				/* background rectangle */
 				XSetForeground(dpy, gc, (i == current_ws) ? config.ws_active_bg : config.ws_inactive_bg);
 				XFillRectangle(dpy, draw, gc, 0, cur_y, w, box_adv);
-				XftColor *col = (i == current_ws) ? &xft_ws_active_fg : &xft_ws_inactive_fg;
-
-				/* draw rotated text centered horizontally within bar */
-				int text_offset = cur_y + config.ws_pad_left + vf->ascent;
-				int cx = xft_center_x(txt, w, vf);
-				XftDrawStringUtf8(xd, col, vf, cx, text_offset,
-						(const FcChar8 *)txt, strlen(txt));
 
+				add_segment(monitor_index, 0, cur_y, w, box_adv, i, -1);
+				AtlasRun r = {pen_x, cur_y + config.ws_pad_left, labels[i]};
+				if (i == current_ws) {
+					active = r;
+				}
+				else {
+					runs[n_inactive++] = r;
+				}
 				cur_y += box_adv + config.ws_spacing;
 			}
-		}
-
-		if (names) {
-			for (int i = 0; i < name_count; i++) {
-				free(names[i]);
+			atlas_draw(atlas, dst, &xft_ws_inactive_fg, True, runs, n_inactive);
+			if (active.text) {
+				atlas_draw(atlas, dst, &xft_ws_active_fg, True, &active, 1);
 			}
-			free(names);
+			free(runs);
 		}
+		free(ws_adv);
 
-		/* modules */
+		/* modules: place every styled run, then one composite per distinct colour */
+		int n_runs = 0;
+		for (int i = 0; i < config.module_count; i++) {
+			const Module *m = &config.modules[i];
+			n_runs += m->enabled && module_on_monitor(m, monitor_index) ? m->run_count : 0;
+		}
+		AtlasRun *runs = malloc((n_runs + 1) * sizeof *runs);
+		const XftColor **cols = malloc((n_runs + 1) * sizeof *cols);
+		n_runs = 0;
 		int my = h - modules_total_adv - 2 * config.text_padding;
 		for (int i = 0; i < config.module_count; i++) {
-			if (!config.modules[i].enabled || !config.modules[i].cached_output) {
+			Module *m = &config.modules[i];
+			if (!m->enabled || !m->cached_output || !module_on_monitor(m, monitor_index)) {
 				continue;
 			}
-			char *out = config.modules[i].cached_output;
-			int adv = xft_text_adv_v(out);
-
-			int cx = xft_center_x(out, w, vf);
-			XftDrawStringUtf8(xd, &xft_fg, vf, cx, my + vf->ascent,
-					(const FcChar8 *)out, strlen(out));
-			my += adv + 20;
+			int ry = my;
+			for (int r = 0; r < m->run_count; r++) {
+				runs[n_runs] = (AtlasRun){pen_x, ry, m->runs[r].text};
+				cols[n_runs++] = m->runs[r].fg ? m->runs[r].fg : &xft_fg;
+				ry += m->runs[r].width;
+			}
+			add_segment(monitor_index, 0, my, w, m->width, -1, i);
+			my += m->width + 20;
+		}
+		AtlasRun *batch = malloc((n_runs + 1) * sizeof *batch);
+		for (int i = 0; i < n_runs; i++) {
+			if (!cols[i]) {
+				continue;
+			}
+			const XftColor *col = cols[i];
+			int n = 0;
+			for (int j = i; j < n_runs; j++) {
+				if (cols[j] == col) {
+					batch[n++] = runs[j];
+					cols[j] = NULL;
+				}
+			}
+			atlas_draw(atlas, dst, col, True, batch, n);
 		}
+		free(batch);
+		free(cols);
+		free(runs);
 
-		XftDrawDestroy(xd);
+		draw_end(draw, xd, w, h);
 		return;
 	}
 
-	int current_ws = get_current_workspace();
-	int name_count = 0;
-	char **names = get_workspace_name(&name_count);
+	int current_ws = bar_workspace(monitor_index);
 
 	/* choose label source */
 	char **labels = NULL;
@@ -437,9 +616,9 @@ void draw_bar_into(Drawable draw, int monitor_index)
 		labels = config.ws_labels;
 		label_count = config.ws_label_count;
 	}
-	else if (names) {
-		labels = names;
-		label_count = name_count;
+	else if (ws_names) {
+		labels = ws_names;
+		label_count = ws_name_count;
 	}
 
 	unsigned text_y = (h + font->ascent - font->descent) / 2;
@@ -461,10 +640,12 @@ void draw_bar_into(Drawable draw, int monitor_index)
 	/* compute starting x for workspaces based on position */
 	int modules_total_w = 0;
 	for (int i = 0; i < config.module_count; i++) {
-		if (!config.modules[i].enabled || !config.modules[i].cached_output) {
+		Module *m = &config.modules[i];
+		if (!m->enabled || !m->cached_output || !module_on_monitor(m, monitor_index)) {
 			continue;
 		}
-		modules_total_w += xft_text_width(config.modules[i].cached_output) + 20;
+		module_layout(m);
+		modules_total_w += module_slot_width(m) + 20;
 	}
 	int modules_block_left = w - modules_total_w - 2 * config.text_padding;
 
@@ -499,77 +680,276 @@ void draw_bar_into(Drawable draw, int monitor_index)
 			unsigned box_h = font->ascent + font->descent + config.ws_pad_left + config.ws_pad_right;
 
 			/* background */
-			XSetForeground(dpy, gc, (i == current_ws) ? config.ws_active_bg : config.ws_inactive_bg);
-			XFillRectangle(dpy, draw, gc, box_x, box_y, box_w, box_h);
+			fill_rect(draw, (i == current_ws) ? config.ws_active_bg : config.ws_inactive_bg,
+					box_x, box_y, box_w, box_h);
 
 			/* text */
-			if (i == current_ws) {
-				XftDrawStringUtf8(
-					xd, &xft_ws_active_fg, font,
-					box_x + config.ws_pad_left, text_y,
-					(const FcChar8 *)tmp, strlen(tmp)
-				);
-			}
-			else {
-				XftDrawStringUtf8(
-					xd, &xft_ws_inactive_fg, font,
-					box_x + config.ws_pad_left, text_y,
-					(const FcChar8 *)tmp, strlen(tmp)
-				);
-			}
+			draw_text(
+				xd, (i == current_ws) ? &xft_ws_active_fg : &xft_ws_inactive_fg,
+				box_x + config.ws_pad_left, text_y, tmp
+			);
 
+			add_segment(monitor_index, box_x, 0, box_w, h, i, -1);
 			cur_x += box_w + config.ws_spacing;
 		}
 	}
 
-	/* free EWMH names if used */
-	if (names) {
-		for (int i = 0; i < name_count; i++) {
-			free(names[i]);
-		}
-		free(names);
-	}
-
 	/* modules */
 	int mx = w - modules_total_w - 2 * config.text_padding;
 	for (int i = 0; i < config.module_count; i++) {
-		if (!config.modules[i].enabled || !config.modules[i].cached_output) {
+		Module *m = &config.modules[i];
+		if (!m->enabled || !m->cached_output || !module_on_monitor(m, monitor_index)) {
 			continue;
 		}
-		char *out = config.modules[i].cached_output;
-		int tw = xft_text_width(out);
-		XftDrawStringUtf8(xd, &xft_fg, font, mx, text_y, (const FcChar8 *)out, strlen(out));
-		mx += tw + 20;
+		m->slot_rx[monitor_index] = w - mx;
+		draw_module(draw, xd, m, mx, h);
+		add_segment(monitor_index, mx, 0, m->slot_w, h, -1, i);
+		mx += m->slot_w + 20;
+	}
+
+	draw_end(draw, xd, w, h);
+}
+
+/* start painting a bar into draw: an Xft draw, or NULL with the monitor's canvas current */
+XftDraw *draw_begin(Drawable draw, int monitor_index, int w, int h)
+{
+#ifdef SXBAR_CLIENT_RENDER
+	/* vertical bars keep the XRender glyph atlas with its rotated glyphs */
+	canvas = client_render && !IS_VERTICAL(BAR_POSITION) ? canvas_for(monitor_index, w, h) : NULL;
+	if (canvas) {
+		canvas_begin(canvas);
+		return NULL;
 	}
+#else
+	(void)monitor_index;
+	(void)w;
+	(void)h;
+#endif
+	return XftDrawCreate(dpy, draw, DefaultVisual(dpy, scr), DefaultColormap(dpy, scr));
+}
 
+/* finish painting: a canvas uploads what changed, bar_damage gets the area to show */
+void draw_end(Drawable draw, XftDraw *xd, int w, int h)
+{
+	bar_damage = (XRectangle){0, 0, w, h};
+#ifdef SXBAR_CLIENT_RENDER
+	if (canvas) {
+		canvas_put(canvas, draw, gc, &bar_damage);
+		canvas = NULL;
+		return;
+	}
+#else
+	(void)draw;
+#endif
 	XftDrawDestroy(xd);
 }
 
-void redraw_monitor(int i)
+/* paint one module's slot of a horizontal bar, background included */
+void draw_module(Drawable draw, XftDraw *xd, Module *m, int x, int h)
 {
-	int w, h;
-	if (config.bar_position == BAR_POS_LEFT || config.bar_position == BAR_POS_RIGHT) {
-		int bw = config.border ? config.border_width : 0;
-		w = config.height;
-		h = monitors[i].height - 2 * config.vertical_padding - 2 * bw;
+	int slot_w = module_slot_width(m);
+	fill_rect(draw, config.background_colour, x, 0, slot_w, h);
+
+	if (slot_w < m->width && xd) {
+		/* overlong text comes from its strip, marquee_tick() later moves just this slot */
+		module_strip(m, h);
+		XCopyArea(dpy, m->strip, draw, gc, m->scroll, 0, slot_w, h, x, 0);
 	}
 	else {
-		int bw = config.border ? config.border_width : 0;
-		w = monitors[i].width - 2 * config.horizontal_padding - 2 * bw;
-		h = config.height;
+		int text_y = (h + font->ascent - font->descent) / 2;
+		int copies = 1;
+		int tx = x;
+#ifdef SXBAR_CLIENT_RENDER
+		/* a canvas needs no strip: the text is drawn clipped to the slot, twice to wrap */
+		if (slot_w < m->width) {
+			copies = m->marquee ? 2 : 1;
+			m->strip_w = m->width + (m->marquee ? MARQUEE_GAP : 0);
+			m->scroll = m->marquee ? m->scroll % m->strip_w : 0;
+			tx = x - m->scroll;
+			canvas_clip(canvas, x, 0, slot_w, h);
+		}
+#endif
+		for (int c = 0; c < copies; c++) {
+			int rx = tx + c * m->strip_w;
+			for (int r = 0; r < m->run_count; r++) {
+				draw_text(xd, m->runs[r].fg ? m->runs[r].fg : &xft_fg, rx, text_y, m->runs[r].text);
+				rx += m->runs[r].width;
+			}
+		}
+#ifdef SXBAR_CLIENT_RENDER
+		if (canvas) {
+			canvas_clip(canvas, 0, 0, 1 << 15, 1 << 15);
+		}
+#endif
+	}
+	m->slot_w = slot_w;
+	m->placed = True;
+	m->changed = False;
+}
+
+/* text onto the current canvas, or through Xft */
+void draw_text(XftDraw *xd, const XftColor *col, int x, int y, const char *s)
+{
+#ifdef SXBAR_CLIENT_RENDER
+	if (canvas) {
+		canvas_text(canvas, col, x, y, s);
+		return;
+	}
+#endif
+	fonts_draw(xd, col, x, y, s);
+}
+
+/* a solid rectangle onto the current canvas, or on the server */
+void fill_rect(Drawable draw, unsigned long pixel, int x, int y, int w, int h)
+{
+#ifdef SXBAR_CLIENT_RENDER
+	if (canvas) {
+		canvas_fill(canvas, pixel, x, y, w, h);
+		return;
+	}
+#endif
+	XSetForeground(dpy, gc, pixel);
+	XFillRectangle(dpy, draw, gc, x, y, w, h);
+}
+
+/*
+ * repaint just the slots of modules whose output changed, as long as none of them changed
+ * width; returns false when the bar needs a full redraw instead
+ */
+int redraw_module_slots(void)
+{
+	if (IS_VERTICAL(BAR_POSITION)) {
+		return False;
+	}
+	for (int i = 0; i < config.module_count; i++) {
+		Module *m = &config.modules[i];
+		if (!m->enabled || !m->changed || !module_shown(m)) {
+			continue;
+		}
+		if (!m->placed || !m->cached_output) {
+			return False;
+		}
+		module_layout(m);
+		if (module_slot_width(m) != m->slot_w) {
+			return False;
+		}
+	}
+
+#ifdef SXBAR_CLIENT_RENDER
+	/* a canvas that was never drawn whole has nothing to patch */
+	for (int j = 0; j < n_monitors && client_render; j++) {
+		int x, y, w, h;
+		bar_geometry(&monitors[j], &x, &y, &w, &h);
+		if (!canvases || !canvas_fits(canvases[j], w, h)) {
+			return False;
+		}
+	}
+#endif
+
+	for (int j = 0; j < n_monitors; j++) {
+		int x, y, w, h;
+		bar_geometry(&monitors[j], &x, &y, &w, &h);
+		XftDraw *xd = draw_begin(buffers[j], j, w, h);
+		for (int i = 0; i < config.module_count; i++) {
+			Module *m = &config.modules[i];
+			if (!m->enabled || !m->changed || !module_on_monitor(m, j)) {
+				continue;
+			}
+			int sx = w - m->slot_rx[j];
+			draw_module(buffers[j], xd, m, sx, h);
+			/* later monitors repaint the same slot, the flag is dropped after the last one */
+			m->changed = True;
+			if (xd) {
+				XCopyArea(dpy, buffers[j], windows[j], gc, sx, 0, m->slot_w, h, sx, 0);
+			}
+		}
+		draw_end(buffers[j], xd, w, h);
+		if (!xd && bar_damage.width) {
+			XCopyArea(dpy, buffers[j], windows[j], gc, bar_damage.x, bar_damage.y,
+					bar_damage.width, bar_damage.height, bar_damage.x, bar_damage.y);
+		}
+	}
+	for (int i = 0; i < config.module_count; i++) {
+		if (config.modules[i].enabled && module_shown(&config.modules[i])) {
+			config.modules[i].changed = False;
+		}
 	}
+	trace_painted(TRACE_SLOTS);
+	return True;
+}
+
+void redraw_monitor(int i)
+{
 	draw_bar_into(buffers[i], i);
-	XCopyArea(dpy, buffers[i], windows[i], gc, 0, 0, w, h, 0, 0);
+	stats_drawn();
+	/* a canvas only uploaded what changed, the window needs no more than that either */
+	if (bar_damage.width) {
+		XCopyArea(dpy, buffers[i], windows[i], gc, bar_damage.x, bar_damage.y,
+				bar_damage.width, bar_damage.height, bar_damage.x, bar_damage.y);
+	}
+}
+
+void redraw_all(void)
+{
+	for (int i = 0; i < n_monitors; i++) {
+		if (redraw_mask & 1u << i) {
+			redraw_monitor(i);
+		}
+	}
+	redraw_mask = ~0u;
+	if (stats_sync_probe()) {
+		/* wait until the server has executed the copies */
+		XSync(dpy, False);
+	}
+	stats_flushed();
+	trace_painted(TRACE_FRAME);
+}
+
+void free_colours(void)
+{
+	XftColorFree(dpy, DefaultVisual(dpy, scr), DefaultColormap(dpy, scr), &xft_fg);
+	XftColorFree(dpy, DefaultVisual(dpy, scr), DefaultColormap(dpy, scr), &xft_bg);
+	XftColorFree(dpy, DefaultVisual(dpy, scr), DefaultColormap(dpy, scr), &xft_ws_inactive_fg);
+	XftColorFree(dpy, DefaultVisual(dpy, scr), DefaultColormap(dpy, scr), &xft_ws_active_fg);
+}
+
+void free_fonts(void)
+{
+#ifdef SXBAR_CLIENT_RENDER
+	canvas_glyphs_free();
+#endif
+	atlas_free(atlas);
+	atlas = NULL;
+	if (font) {
+		fonts_close();
+	}
+	font = NULL;
+}
+
+Window get_active_window(void)
+{
+	Window win = None;
+	Atom ret_type;
+	int fmt;
+	unsigned long n, after;
+	unsigned char *data = NULL;
+	if (XGetWindowProperty(dpy, root, atoms[NET_ACTIVE_WINDOW], 0, 1, False, XA_WINDOW,
+		&ret_type, &fmt, &n, &after, &data) == Success && data) {
+		if (n) {
+			win = *(Window *)data;
+		}
+		XFree(data);
+	}
+	return win;
 }
 
 int get_current_workspace(void)
 {
-	Atom at = XInternAtom(dpy, "_NET_CURRENT_DESKTOP", False);
 	Atom ret_type;
 	int fmt;
 	unsigned long n, after;
 	unsigned char *data = NULL;
-	if (XGetWindowProperty(dpy, root, at, 0, 1, False, XA_CARDINAL,
+	if (XGetWindowProperty(dpy, root, atoms[NET_CURRENT_DESKTOP], 0, 1, False, XA_CARDINAL,
 		&ret_type, &fmt, &n, &after, &data) == Success && data) {
 		int ws = *(unsigned long *)data;
 		XFree(data);
@@ -578,32 +958,79 @@ int get_current_workspace(void)
 	return -1;
 }
 
-char **get_workspace_name(int *count)
+char *get_window_title(Window w)
 {
-	Atom at = XInternAtom(dpy, "_NET_DESKTOP_NAMES", False);
-	Atom utf8 = XInternAtom(dpy, "UTF8_STRING", False);
 	Atom ret_type;
 	int fmt;
 	unsigned long n, after;
 	unsigned char *data = NULL;
-	if (XGetWindowProperty(dpy, root, at, 0, (~0L), False, utf8,
+	if (XGetWindowProperty(dpy, w, atoms[NET_WM_NAME], 0, 1024, False, atoms[UTF8_STRING],
 		&ret_type, &fmt, &n, &after, &data) == Success && data) {
-		char **names = NULL;
-		int idx = 0;
-		char *p = (char *)data;
-		while (p < (char *)data + n && idx < MAX_MONITORS) {
-			names = realloc(names, (idx + 1) * sizeof *names);
-			names[idx++] = strdup(p);
-			p += strlen(p) + 1;
+		char *title = strndup((char *)data, n);
+		XFree(data);
+		return title;
+	}
+
+	/* clients without EWMH names still set WM_NAME, possibly in a legacy encoding */
+	XTextProperty tp;
+	char *title = NULL;
+	if (XGetWMName(dpy, w, &tp) && tp.value) {
+		char **list = NULL;
+		int count;
+		if (Xutf8TextPropertyToTextList(dpy, &tp, &list, &count) >= Success && count > 0 && *list) {
+			title = strdup(*list);
+		}
+		if (list) {
+			XFreeStringList(list);
 		}
+		XFree(tp.value);
+	}
+	return title ? title : strdup("");
+}
+
+char **get_workspace_name(int *count)
+{
+	Atom ret_type;
+	int fmt;
+	unsigned long n, after;
+	unsigned char *data = NULL;
+	if (XGetWindowProperty(dpy, root, atoms[NET_DESKTOP_NAMES], 0, (~0L), False, atoms[UTF8_STRING],
+		&ret_type, &fmt, &n, &after, &data) == Success && data) {
+		char **names = strlist_pack((const char *)data, n, MAX_MONITORS, count);
 		XFree(data);
-		*count = idx;
 		return names;
 	}
 	*count = 0;
 	return NULL;
 }
 
+/* a workspace label switches to its desktop, a module starts its action for the button */
+void hdl_button(XEvent *xev)
+{
+	XButtonEvent *be = &xev->xbutton;
+	int i = find_window_monitor(be->window);
+	const Segment *seg = i >= 0 ? segment_at(i, be->x, be->y) : NULL;
+	if (!seg) {
+		return;
+	}
+	if (seg->workspace >= 0) {
+		if (be->button == Button1) {
+			switch_workspace(seg->workspace, be->time);
+		}
+		return;
+	}
+	if (seg->module >= config.module_count) {
+		return;
+	}
+	const Module *m = &config.modules[seg->module];
+	const char *cmd = be->button == Button1 ? m->on_click
+		: be->button == Button4 ? m->on_scroll_up
+		: be->button == Button5 ? m->on_scroll_down : NULL;
+	if (cmd && *cmd && module_action(seg->module, cmd) < 0) {
+		warn("fork");
+	}
+}
+
 void hdl_dummy(XEvent *xev)
 {
 	(void)xev;
@@ -611,177 +1038,1353 @@ void hdl_dummy(XEvent *xev)
 
 void hdl_expose(XEvent *xev)
 {
-	int idx = find_window_monitor(xev->xexpose.window);
-	redraw_monitor(idx);
+	/* the back buffer is still current, only the last expose of a series needs a copy */
+	if (xev->xexpose.count > 0) {
+		return;
+	}
+	int i = find_window_monitor(xev->xexpose.window);
+	if (i < 0) {
+		return;
+	}
+	int x, y, w, h;
+	bar_geometry(&monitors[i], &x, &y, &w, &h);
+	XCopyArea(dpy, buffers[i], windows[i], gc, 0, 0, w, h, 0, 0);
+	trace_painted(TRACE_COPY);
 }
 
 void hdl_property(XEvent *xev)
 {
-	if (xev->xproperty.atom == XInternAtom(dpy, "_NET_CURRENT_DESKTOP", False)) {
-		for (int i = 0; i < n_monitors; i++) {
-			redraw_monitor(i);
+	if (active_win != None && xev->xproperty.window == active_win) {
+		if (xev->xproperty.atom == atoms[NET_WM_NAME] || xev->xproperty.atom == XA_WM_NAME) {
+			dirty |= DIRTY_TITLE;
 		}
+		return;
+	}
+	if (xev->xproperty.window != root) {
+		return;
+	}
+	if (xev->xproperty.atom == atoms[NET_CURRENT_DESKTOP]) {
+		stats_ws_event(xev->xproperty.time);
+		dirty |= DIRTY_WS_CURRENT;
+	}
+	else if (xev->xproperty.atom == atoms[NET_DESKTOP_NAMES]) {
+		dirty |= DIRTY_WS_NAMES;
+	}
+	else if (xev->xproperty.atom == atoms[NET_ACTIVE_WINDOW]) {
+		dirty |= DIRTY_ACTIVE;
 	}
 }
 
-void init_defaults(void)
+void init_defaults(Config *cfg)
 {
-	config.bar_position = BAR_POS_BOTTOM;
-	config.height = 19;
-	config.vertical_padding = 0;
-	config.horizontal_padding = 0;
-	config.text_padding = 0;
-	config.border = False;
-	config.border_width = 0;
-	config.background_colour = parse_col("#000000");
-	config.foreground_colour = parse_col("#7abccd");
-	config.border_colour = parse_col("#005577");
-	config.font = strdup("monospace");
-	config.font_size = 0;
+	memset(&cfg->arena, 0, sizeof cfg->arena);
+	cfg->bar_position = BAR_POS_BOTTOM;
+	cfg->height = 19;
+	cfg->vertical_padding = 0;
+	cfg->horizontal_padding = 0;
+	cfg->text_padding = 0;
+	cfg->border = False;
+	cfg->border_width = 0;
+	cfg->background_colour = parse_col("#000000");
+	cfg->foreground_colour = parse_col("#7abccd");
+	cfg->border_colour = parse_col("#005577");
+	cfg->font = arena_strdup(&cfg->arena, "monospace");
+	cfg->font_fallback = NULL;
+	cfg->font_size = 0;
 
 	/* modules */
-	config.modules = NULL;
-	config.module_count = 0;
-	config.max_modules = 0;
+	cfg->modules = NULL;
+	cfg->module_count = 0;
+	cfg->max_modules = 0;
+	cfg->marquee_fps = 30;
+	cfg->battery_multiplier = 1;
+	cfg->timer_slack = 0;
+	memset(&cfg->spawn, 0, sizeof cfg->spawn);
 
 	/* workspace customization defaults */
-	config.ws_labels = NULL;
-	config.ws_label_count = 0;
-	config.ws_active_bg = config.foreground_colour;
-	config.ws_active_fg = config.background_colour;
-	config.ws_inactive_bg = config.background_colour;
-	config.ws_inactive_fg = config.foreground_colour;
-	config.ws_pad_left = 5;
-	config.ws_pad_right = 5;
-	config.ws_spacing = 10;
-	config.ws_position = WS_POS_LEFT;
+	cfg->ws_labels = NULL;
+	cfg->ws_label_count = 0;
+	cfg->ws_active_bg = cfg->foreground_colour;
+	cfg->ws_active_fg = cfg->background_colour;
+	cfg->ws_inactive_bg = cfg->background_colour;
+	cfg->ws_inactive_fg = cfg->foreground_colour;
+	cfg->ws_pad_left = 5;
+	cfg->ws_pad_right = 5;
+	cfg->ws_spacing = 10;
+	cfg->ws_position = WS_POS_LEFT;
+	cfg->ws_per_monitor = False;
 }
 
-
-int find_window_monitor(Window win)
+#ifdef SXBAR_STATIC_CONFIG
+/* fill cfg from config.h; strings are copied into the arena like a parsed config's */
+void static_config(Config *cfg)
 {
-	for (int i = 0; i < n_monitors; i++) {
-		if (windows[i] == win) {
-			return i;
-		}
+	Arena *a = &cfg->arena;
+	memset(a, 0, sizeof *a);
+	cfg->bar_position = BAR_POSITION;
+	cfg->height = HEIGHT;
+	cfg->vertical_padding = VERTICAL_PADDING;
+	cfg->horizontal_padding = HORIZONTAL_PADDING;
+	cfg->text_padding = TEXT_PADDING;
+	cfg->border = BORDER;
+	cfg->border_width = BORDER_WIDTH;
+	cfg->background_colour = parse_col(BACKGROUND_COLOUR);
+	cfg->foreground_colour = parse_col(FOREGROUND_COLOUR);
+	cfg->border_colour = parse_col(BORDER_COLOUR);
+	cfg->font = arena_strdup(a, FONT);
+	const char *fallback = FONT_FALLBACK;
+	cfg->font_fallback = fallback ? arena_strdup(a, fallback) : NULL;
+	cfg->font_size = FONT_SIZE;
+
+	/* modules */
+	cfg->module_count = sizeof module_table / sizeof *module_table;
+	cfg->max_modules = cfg->module_count;
+	cfg->modules = malloc(cfg->module_count * sizeof *cfg->modules);
+	for (int i = 0; i < cfg->module_count; i++) {
+		Module *m = &cfg->modules[i];
+		*m = module_table[i];
+		m->name = m->name ? arena_strdup(a, m->name) : NULL;
+		m->command = m->command ? arena_strdup(a, m->command) : NULL;
+		m->path = m->path ? arena_strdup(a, m->path) : NULL;
+		m->spawn.cpus = m->spawn.cpus ? arena_strdup(a, m->spawn.cpus) : NULL;
+		m->spawn.cgroup = m->spawn.cgroup ? arena_strdup(a, m->spawn.cgroup) : NULL;
+		m->on_click = m->on_click ? arena_strdup(a, m->on_click) : NULL;
+		m->on_scroll_up = m->on_scroll_up ? arena_strdup(a, m->on_scroll_up) : NULL;
+		m->on_scroll_down = m->on_scroll_down ? arena_strdup(a, m->on_scroll_down) : NULL;
+		if (m->refresh_interval <= 0) {
+			m->refresh_interval = 1000;
+		}
 	}
-	return 0;
+	cfg->marquee_fps = MARQUEE_FPS;
+	cfg->battery_multiplier = BATTERY_MULTIPLIER;
+	cfg->timer_slack = TIMER_SLACK;
+	memset(&cfg->spawn, 0, sizeof cfg->spawn);
+
+	/* workspace customization */
+	cfg->ws_label_count = sizeof ws_label_table / sizeof *ws_label_table;
+	cfg->ws_labels = arena_alloc(a, cfg->ws_label_count * sizeof *cfg->ws_labels);
+	for (int i = 0; i < cfg->ws_label_count; i++) {
+		cfg->ws_labels[i] = arena_strdup(a, ws_label_table[i]);
+	}
+	cfg->ws_active_bg = parse_col(WS_ACTIVE_BACKGROUND);
+	cfg->ws_active_fg = parse_col(WS_ACTIVE_FOREGROUND);
+	cfg->ws_inactive_bg = parse_col(WS_INACTIVE_BACKGROUND);
+	cfg->ws_inactive_fg = parse_col(WS_INACTIVE_FOREGROUND);
+	cfg->ws_pad_left = WS_PADDING_LEFT;
+	cfg->ws_pad_right = WS_PADDING_RIGHT;
+	cfg->ws_spacing = WS_SPACING;
+	cfg->ws_position = WS_POSITION;
+	cfg->ws_per_monitor = WS_PER_MONITOR;
+}
+#endif
+
+void add_segment(int monitor_index, int x, int y, int w, int h, int workspace, int module)
+{
+	int i = monitor_index;
+	if (segment_count[i] == segment_cap[i]) {
+		segment_cap[i] = segment_cap[i] ? 2 * segment_cap[i] : 16;
+		segments[i] = realloc(segments[i], segment_cap[i] * sizeof *segments[i]);
+	}
+	segments[i][segment_count[i]++] = (Segment){x, y, w, h, workspace, module};
+}
+
+/* the segment of a bar under x, y, NULL over empty space */
+const Segment *segment_at(int monitor_index, int x, int y)
+{
+	for (int i = 0; i < segment_count[monitor_index]; i++) {
+		const Segment *s = &segments[monitor_index][i];
+		if (x >= s->x && x < s->x + s->w && y >= s->y && y < s->y + s->h) {
+			return s;
+		}
+	}
+	return NULL;
+}
+
+/* ask the window manager for a desktop switch, as pagers do */
+void switch_workspace(int index, Time when)
+{
+	XEvent ev;
+	memset(&ev, 0, sizeof ev);
+	ev.xclient.type = ClientMessage;
+	ev.xclient.window = root;
+	ev.xclient.message_type = atoms[NET_CURRENT_DESKTOP];
+	ev.xclient.format = 32;
+	ev.xclient.data.l[0] = index;
+	ev.xclient.data.l[1] = when;
+	XSendEvent(dpy, root, False, SubstructureNotifyMask | SubstructureRedirectMask, &ev);
+}
+
+/* the monitor whose bar is win, -1 for any other window */
+int find_window_monitor(Window win)
+{
+	for (int i = 0; i < n_monitors; i++) {
+		if (windows[i] == win) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+void load_fonts(void)
+{
+	font = fonts_open(dpy, scr, config.font, config.font_size, config.font_fallback);
+	if (!font) {
+		errx(1, "could not load font %s (size %d)", config.font, config.font_size);
+	}
+
+	/* vertical bars draw pre-rotated glyphs from the atlas */
+	if (IS_VERTICAL(BAR_POSITION)) {
+		if (!(atlas = atlas_new(dpy))) {
+			errx(1, "could not build glyph atlas for %s", config.font);
+		}
+	}
+}
+
+/* parse the markup of a module's output and measure its runs, once per output change */
+void module_layout(Module *m)
+{
+	if (m->runs || !m->cached_output) {
+		return;
+	}
+	if (m->strip) {
+		XFreePixmap(dpy, m->strip);
+		m->strip = None;
+	}
+	m->run_count = markup_parse(m->cached_output, &m->runs);
+	m->width = 0;
+	for (int i = 0; i < m->run_count; i++) {
+		MarkupRun *r = &m->runs[i];
+		r->fg = r->has_fg ? markup_colour(dpy, scr, r->rgb) : NULL;
+		r->width = IS_VERTICAL(BAR_POSITION) ? atlas_advance(atlas, r->text, True)
+			: xft_text_width(r->text);
+		m->width += r->width;
+	}
+}
+
+/* render the whole text once, a second copy after the gap lets the window wrap around */
+void module_strip(Module *m, int h)
+{
+	if (m->strip) {
+		return;
+	}
+	int copies = m->marquee ? 2 : 1;
+	m->strip_w = m->width + (m->marquee ? MARQUEE_GAP : 0);
+	m->scroll = m->marquee ? m->scroll % m->strip_w : 0;
+	m->strip = XCreatePixmap(dpy, root, m->strip_w * copies, h, DefaultDepth(dpy, scr));
+
+	XSetForeground(dpy, gc, config.background_colour);
+	XFillRectangle(dpy, m->strip, gc, 0, 0, m->strip_w * copies, h);
+	XftDraw *xd = XftDrawCreate(dpy, m->strip, DefaultVisual(dpy, scr), DefaultColormap(dpy, scr));
+	int text_y = (h + font->ascent - font->descent) / 2;
+	for (int c = 0; c < copies; c++) {
+		int x = c * m->strip_w;
+		for (int r = 0; r < m->run_count; r++) {
+			fonts_draw(xd, m->runs[r].fg ? m->runs[r].fg : &xft_fg, x, text_y, m->runs[r].text);
+			x += m->runs[r].width;
+		}
+	}
+	XftDrawDestroy(xd);
+}
+
+int module_slot_width(const Module *m)
+{
+	if (m->max_width > 0 && m->width > m->max_width && !IS_VERTICAL(BAR_POSITION)) {
+		return m->max_width;
+	}
+	return m->width;
+}
+
+/* scroll every overlong marquee module by a pixel, copying only its slot to each bar */
+void marquee_tick(void)
+{
+	for (int i = 0; i < config.module_count; i++) {
+		Module *m = &config.modules[i];
+		if (!marquee_scrolls(m)) {
+			continue;
+		}
+		m->scroll = (m->scroll + 1) % m->strip_w;
+		for (int j = 0; j < n_monitors; j++) {
+			if (!module_on_monitor(m, j)) {
+				continue;
+			}
+			int x, y, w, h;
+			bar_geometry(&monitors[j], &x, &y, &w, &h);
+			int sx = w - m->slot_rx[j];
+#ifdef SXBAR_CLIENT_RENDER
+			if (client_render) {
+				/* redrawn on the canvas, the upload covers the columns that moved */
+				if (!canvases || !canvas_fits(canvases[j], w, h)) {
+					continue;
+				}
+				XftDraw *xd = draw_begin(buffers[j], j, w, h);
+				draw_module(buffers[j], xd, m, sx, h);
+				draw_end(buffers[j], xd, w, h);
+				if (bar_damage.width) {
+					XCopyArea(dpy, buffers[j], windows[j], gc, bar_damage.x, bar_damage.y,
+							bar_damage.width, bar_damage.height, bar_damage.x, bar_damage.y);
+				}
+				continue;
+			}
+#endif
+			XCopyArea(dpy, m->strip, buffers[j], gc, m->scroll, 0, m->max_width, h, sx, 0);
+			XCopyArea(dpy, buffers[j], windows[j], gc, sx, 0, m->max_width, h, sx, 0);
+		}
+	}
+}
+
+int marquee_active(void)
+{
+	if (config.marquee_fps <= 0) {
+		return False;
+	}
+	for (int i = 0; i < config.module_count; i++) {
+		if (marquee_scrolls(&config.modules[i])) {
+			return True;
+		}
+	}
+	return False;
+}
+
+/* an overlong marquee module on screen, drawn from its strip or straight onto a canvas */
+int marquee_scrolls(const Module *m)
+{
+	if (!m->enabled || !m->marquee || module_slot_width(m) >= m->width) {
+		return False;
+	}
+#ifdef SXBAR_CLIENT_RENDER
+	if (client_render) {
+		return m->placed && m->runs && m->strip_w > 0;
+	}
+#endif
+	return m->strip != None;
+}
+
+#ifdef SXBAR_CLIENT_RENDER
+void free_canvases(void)
+{
+	if (!canvases) {
+		return;
+	}
+	for (int i = 0; i < n_monitors; i++) {
+		canvas_free(canvases[i]);
+	}
+	free(canvases);
+	canvases = NULL;
+}
+#endif
+
+void free_strips(Config *cfg)
+{
+	for (int i = 0; i < cfg->module_count; i++) {
+		if (cfg->modules[i].strip) {
+			XFreePixmap(dpy, cfg->modules[i].strip);
+			cfg->modules[i].strip = None;
+		}
+	}
+}
+
+void load_config(void)
+{
+#ifdef SXBAR_STATIC_CONFIG
+	static_config(&config);
+#else
+	if (!config_path) {
+		config_path = get_config_path();
+	}
+	init_defaults(&config);
+	parse_config(config_path, &config);
+#endif
+}
+
+void open_display(void)
+{
+	if (!(dpy = XOpenDisplay(NULL))) {
+		errx(1, "can't open display");
+	}
+	root = XDefaultRootWindow(dpy);
+	scr = DefaultScreen(dpy);
+
+	char *names[ATOM_LAST] = {
+		[NET_ACTIVE_WINDOW] = "_NET_ACTIVE_WINDOW",
+		[NET_CURRENT_DESKTOP] = "_NET_CURRENT_DESKTOP",
+		[NET_DESKTOP_NAMES] = "_NET_DESKTOP_NAMES",
+		[NET_WM_NAME] = "_NET_WM_NAME",
+		[NET_WM_STRUT_PARTIAL] = "_NET_WM_STRUT_PARTIAL",
+		[NET_WM_WINDOW_TYPE] = "_NET_WM_WINDOW_TYPE",
+		[NET_WM_WINDOW_TYPE_DOCK] = "_NET_WM_WINDOW_TYPE_DOCK",
+		[UTF8_STRING] = "UTF8_STRING",
+	};
+#ifdef SXBAR_XCB
+	backend_init(dpy);
+	backend_intern_atoms(names, ATOM_LAST, atoms);
+#else
+	XInternAtoms(dpy, names, ATOM_LAST, False, atoms);
+#endif
+#ifdef SXBAR_CLIENT_RENDER
+	/* other visuals keep drawing on the server */
+	client_render = canvas_usable(dpy, scr);
+#endif
 }
 
 unsigned long parse_col(const char *hex)
 {
-	XColor col;
-	Colormap cmap = DefaultColormap(dpy, scr);
-	if (!XParseColor(dpy, cmap, hex, &col) || !XAllocColor(dpy, cmap, &col)) {
+	unsigned long pixel;
+	if (!alloc_col(hex, &pixel)) {
 		fprintf(stderr, "sxbar: cannot parse/color %s\n", hex);
-		return WhitePixel(dpy, scr);
+		return dpy ? WhitePixel(dpy, scr) : 0;
 	}
-	return col.pixel;
+	return pixel;
 }
 
+/* a recorded monitor layout, "x,y,w,h" per monitor separated by spaces */
+XineramaScreenInfo *parse_layout(const char *s, int *count)
+{
+	XineramaScreenInfo *mons = NULL;
+	int n = 0, x, y, w, h, used;
+	while (sscanf(s, "%d,%d,%d,%d%n", &x, &y, &w, &h, &used) == 4) {
+		mons = realloc(mons, (n + 1) * sizeof *mons);
+		mons[n] = (XineramaScreenInfo){n, x, y, w, h};
+		n++;
+		s += used;
+	}
+	*count = n;
+	return mons;
+}
+
+XineramaScreenInfo *query_monitors(int *count)
+{
+	XineramaScreenInfo *mons = NULL;
+	int n = 0;
+
+	if (replay_layout) {
+		mons = malloc(replay_layout_count * sizeof *mons);
+		memcpy(mons, replay_layout, replay_layout_count * sizeof *mons);
+		*count = replay_layout_count;
+		return mons;
+	}
+
+	if (XineramaIsActive(dpy)) {
+		XineramaScreenInfo *xs = XineramaQueryScreens(dpy, &n);
+		if (xs && n > 0) {
+			/* module and workspace state is kept per monitor in fixed arrays */
+			n = n > MAX_MONITORS ? MAX_MONITORS : n;
+			mons = malloc(n * sizeof *mons);
+			memcpy(mons, xs, n * sizeof *mons);
+		}
+		if (xs) {
+			XFree(xs);
+		}
+	}
+	if (!mons) {
+		n = 1;
+		mons = malloc(sizeof *mons);
+		mons[0].screen_number = 0;
+		mons[0].x_org = 0;
+		mons[0].y_org = 0;
+		mons[0].width = DisplayWidth(dpy, scr);
+		mons[0].height = DisplayHeight(dpy, scr);
+#ifdef SXBAR_XCB
+		/* without XRRUpdateConfiguration() the sizes above are stale after a hotplug */
+		int rw, rh;
+		if (backend_root_size(root, &rw, &rh) == 0) {
+			mons[0].width = rw;
+			mons[0].height = rh;
+		}
+#endif
+	}
+
+	*count = n;
+	return mons;
+}
+
+/* the monitor the RandR primary output is shown on, the first one without */
+int find_primary_monitor(void)
+{
+	int found = 0;
+	if (replay_layout) {
+		return 0;
+	}
+	RROutput out = XRRGetOutputPrimary(dpy, root);
+	XRRScreenResources *res = out ? XRRGetScreenResourcesCurrent(dpy, root) : NULL;
+	XRROutputInfo *oi = res ? XRRGetOutputInfo(dpy, res, out) : NULL;
+	XRRCrtcInfo *ci = oi && oi->crtc ? XRRGetCrtcInfo(dpy, res, oi->crtc) : NULL;
+	for (int i = 0; ci && i < n_monitors; i++) {
+		if (monitors[i].x_org == ci->x && monitors[i].y_org == ci->y) {
+			found = i;
+			break;
+		}
+	}
+	if (ci) {
+		XRRFreeCrtcInfo(ci);
+	}
+	if (oi) {
+		XRRFreeOutputInfo(oi);
+	}
+	if (res) {
+		XRRFreeScreenResources(res);
+	}
+	return found;
+}
+
+/* the monitor under the pointer, which is where a desktop switch most likely happened */
+int pointer_monitor(void)
+{
+	Window r, c;
+	int x, y, wx, wy;
+	unsigned int mask;
+	if (!XQueryPointer(dpy, root, &r, &c, &x, &y, &wx, &wy, &mask)) {
+		return -1;
+	}
+	for (int i = 0; i < n_monitors; i++) {
+		if (x >= monitors[i].x_org && x < monitors[i].x_org + monitors[i].width &&
+			y >= monitors[i].y_org && y < monitors[i].y_org + monitors[i].height) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* module.N.monitors: no restriction means every bar */
+int module_on_monitor(const Module *m, int monitor_index)
+{
+	if (!m->monitor_mask && !m->on_primary) {
+		return True;
+	}
+	return (m->monitor_mask & 1u << monitor_index) ||
+		(m->on_primary && monitor_index == primary_monitor);
+}
+
+int module_shown(const Module *m)
+{
+	for (int i = 0; i < n_monitors; i++) {
+		if (module_on_monitor(m, i)) {
+			return True;
+		}
+	}
+	return False;
+}
+
+/* the desktop a bar highlights */
+int bar_workspace(int monitor_index)
+{
+	if (config.ws_per_monitor && ws_monitor[monitor_index] >= 0) {
+		return ws_monitor[monitor_index];
+	}
+	return ws_current;
+}
+
+/* --record: log the value an event changed to, read back right away so bursts stay bursts */
+void record_event(const XEvent *xev)
+{
+	if (xev->type == Expose && xev->xexpose.count == 0) {
+		int i = find_window_monitor(xev->xexpose.window);
+		if (i >= 0) {
+			trace_record(TRACE_EXPOSE, i, NULL, 0);
+		}
+		return;
+	}
+	if (xev->type != PropertyNotify) {
+		return;
+	}
+
+	const XPropertyEvent *pe = &xev->xproperty;
+	if (pe->window == active_win && (pe->atom == atoms[NET_WM_NAME] || pe->atom == XA_WM_NAME)) {
+		char *title = get_window_title(active_win);
+		trace_record(TRACE_TITLE, 0, title, strlen(title));
+		free(title);
+	}
+	else if (pe->window != root) {
+		return;
+	}
+	else if (pe->atom == atoms[NET_CURRENT_DESKTOP]) {
+		char buf[16];
+		int n = snprintf(buf, sizeof buf, "%d", get_current_workspace());
+		trace_record(TRACE_DESKTOP, 0, buf, n);
+	}
+	else if (pe->atom == atoms[NET_DESKTOP_NAMES]) {
+		Atom ret_type;
+		int fmt;
+		unsigned long n = 0, after;
+		unsigned char *data = NULL;
+		XGetWindowProperty(dpy, root, atoms[NET_DESKTOP_NAMES], 0, (~0L), False,
+				atoms[UTF8_STRING], &ret_type, &fmt, &n, &after, &data);
+		trace_record(TRACE_NAMES, 0, data ? (const char *)data : "", data ? n : 0);
+		if (data) {
+			XFree(data);
+		}
+	}
+	else if (pe->atom == atoms[NET_ACTIVE_WINDOW]) {
+		Window win = get_active_window();
+		char *title = win != None ? get_window_title(win) : strdup("");
+		trace_record(TRACE_ACTIVE, 0, title, strlen(title));
+		free(title);
+	}
+}
+
+void record_layout(void)
+{
+	char *buf = malloc(n_monitors * 48 + 1);
+	int len = 0;
+	for (int i = 0; i < n_monitors; i++) {
+		len += sprintf(buf + len, "%s%d,%d,%d,%d", i ? " " : "", monitors[i].x_org,
+				monitors[i].y_org, monitors[i].width, monitors[i].height);
+	}
+	trace_record(TRACE_MONITORS, 0, buf, len);
+	free(buf);
+}
+
+/* --replay: play the due trace events to the server, true if a module's output changed */
+int replay_due(int *monitors_changed)
+{
+	int changed = False;
+	int sent = False;
+	const TraceEvent *e;
+
+	while ((e = trace_next())) {
+		const char *data = e->data ? e->data : "";
+		long ws = atol(data);
+		switch (e->kind) {
+			case TRACE_MONITORS:
+				free(replay_layout);
+				replay_layout = parse_layout(data, &replay_layout_count);
+				*monitors_changed = True;
+				break;
+			case TRACE_DESKTOP:
+				XChangeProperty(dpy, root, atoms[NET_CURRENT_DESKTOP], XA_CARDINAL, 32,
+						PropModeReplace, (unsigned char *)&ws, 1);
+				sent = True;
+				break;
+			case TRACE_NAMES:
+				XChangeProperty(dpy, root, atoms[NET_DESKTOP_NAMES], atoms[UTF8_STRING], 8,
+						PropModeReplace, (const unsigned char *)data, e->len);
+				sent = True;
+				break;
+			case TRACE_ACTIVE:
+			case TRACE_TITLE:
+				/* one stand-in window, a focus change is its title changing with the root's */
+				XChangeProperty(dpy, replay_win, atoms[NET_WM_NAME], atoms[UTF8_STRING], 8,
+						PropModeReplace, (const unsigned char *)data, e->len);
+				if (e->kind == TRACE_ACTIVE) {
+					XChangeProperty(dpy, root, atoms[NET_ACTIVE_WINDOW], XA_WINDOW, 32,
+							PropModeReplace, (unsigned char *)&replay_win, 1);
+				}
+				sent = True;
+				break;
+			case TRACE_EXPOSE:
+				if (e->index < n_monitors) {
+					XClearArea(dpy, windows[e->index], 0, 0, 0, 0, True);
+					sent = True;
+				}
+				break;
+			case TRACE_MODULE:
+				if (e->index < config.module_count) {
+					changed |= module_set_output(&config.modules[e->index], e->data);
+				}
+				break;
+		}
+	}
+	/* the notifies the server sends back belong to this iteration's events */
+	if (sent) {
+		XSync(dpy, False);
+	}
+	return changed;
+}
+
+#ifdef SXBAR_STATIC_CONFIG
+void reload_config(void)
+{
+	/* settings are compiled in, there is nothing to re-read */
+}
+#else
+void reload_config(void)
+{
+	Config next;
+	init_defaults(&next);
+	int errors = parse_config(config_path, &next);
+	if (errors != 0) {
+		/* a vanished or mistyped file never replaces the live config, half parsed or not */
+		if (errors > 0) {
+			warnx("%s: %d error(s), keeping the running config", config_path, errors);
+		}
+		free_config(&next);
+		return;
+	}
+	modules_actions_forget();
+
+	int fonts_changed = strcmp(next.font, config.font) || next.font_size != config.font_size ||
+		!next.font_fallback != !config.font_fallback ||
+		(next.font_fallback && strcmp(next.font_fallback, config.font_fallback)) ||
+		IS_VERTICAL(next.bar_position) != IS_VERTICAL(config.bar_position);
+	int colours_changed = next.foreground_colour != config.foreground_colour ||
+		next.background_colour != config.background_colour ||
+		next.ws_active_fg != config.ws_active_fg ||
+		next.ws_inactive_fg != config.ws_inactive_fg;
+	int attrs_changed = next.background_colour != config.background_colour ||
+		next.border_colour != config.border_colour;
+	int geometry_changed = next.bar_position != config.bar_position ||
+		next.height != config.height ||
+		next.vertical_padding != config.vertical_padding ||
+		next.horizontal_padding != config.horizontal_padding ||
+		next.border != config.border || next.border_width != config.border_width;
+
+	/* keep the output of modules whose command did not change */
+	for (int i = 0; i < next.module_count; i++) {
+		Module *nm = &next.modules[i];
+		for (int j = 0; j < config.module_count && nm->command; j++) {
+			Module *om = &config.modules[j];
+			if (!om->cached_output || !om->command || strcmp(om->command, nm->command)) {
+				continue;
+			}
+			nm->cached_output = om->cached_output;
+			nm->output_cap = om->output_cap;
+			nm->last_update = om->last_update;
+			om->cached_output = NULL;
+			om->output_cap = 0;
+			break;
+		}
+	}
+
+	/* remember the old bar sizes so pixmaps are only recreated when needed */
+	int *old_w = malloc(n_monitors * sizeof *old_w);
+	int *old_h = malloc(n_monitors * sizeof *old_h);
+	for (int i = 0; i < n_monitors; i++) {
+		int x, y;
+		bar_geometry(&monitors[i], &x, &y, &old_w[i], &old_h[i]);
+	}
+
+	if (colours_changed) {
+		free_colours();
+	}
+	free_strips(&config);
+	free_config(&config);
+	config = next;
+
+	if (fonts_changed) {
+		free_fonts();
+		load_fonts();
+	}
+	if (colours_changed) {
+		alloc_colours();
+	}
+
+	for (int i = 0; i < n_monitors && (geometry_changed || attrs_changed); i++) {
+		if (attrs_changed) {
+			XSetWindowBackground(dpy, windows[i], config.background_colour);
+			XSetWindowBorder(dpy, windows[i], config.border_colour);
+		}
+		if (!geometry_changed) {
+			continue;
+		}
+
+		int x, y, w, h;
+		bar_geometry(&monitors[i], &x, &y, &w, &h);
+		XSetWindowBorderWidth(dpy, windows[i], config.border ? config.border_width : 0);
+		XMoveResizeWindow(dpy, windows[i], x, y, w, h);
+		set_bar_strut(windows[i], x, y, w, h);
+		if (w != old_w[i] || h != old_h[i]) {
+			XFreePixmap(dpy, buffers[i]);
+			buffers[i] = XCreatePixmap(dpy, windows[i], w, h, DefaultDepth(dpy, scr));
+		}
+	}
+	free(old_w);
+	free(old_h);
+
+	if (stdin_mode) {
+		status_apply();
+	}
+	update_modules();
+	modules_watch();
+	dirty |= DIRTY_BARS | DIRTY_ACTIVE;
+}
+#endif
+
 void run(void)
 {
 	XEvent xev;
-	time_t last = 0;
+	struct timespec next_frame = {0};
+	struct pollfd pfd[4] = {
+		{.fd = ConnectionNumber(dpy), .events = POLLIN},
+		{.fd = -1, .events = POLLIN},	/* inotify, while file modules exist */
+		{.fd = -1, .events = POLLIN},	/* status generator, in --stdin mode */
+		{.fd = child_pipe[0], .events = POLLIN},	/* a click action exited */
+	};
 
 	while (True) {
+		int monitors_changed = False;
+		int replayed = trace_replaying() && replay_due(&monitors_changed);
+#ifdef SXBAR_XCB
+		while (backend_next_event(&xev)) {
+#else
 		while (XPending(dpy)) {
 			XNextEvent(dpy, &xev);
-			evtable[xev.type](&xev);
+#endif
+			if (trace_recording()) {
+				record_event(&xev);
+			}
+			if (randr_event_base >= 0 &&
+				(xev.type == randr_event_base + RRScreenChangeNotify ||
+				 xev.type == randr_event_base + RRNotify)) {
+#ifndef SXBAR_XCB
+				/* the translated xcb event carries no geometry to update Xlib with */
+				XRRUpdateConfiguration(&xev);
+#endif
+				monitors_changed = True;
+				continue;
+			}
+			if (xev.type < LASTEvent) {
+				evtable[xev.type](&xev);
+			}
 		}
-		time_t now = time(NULL);
-		if (now - last >= 1) {
-			update_modules();
-			for (int i = 0; i < n_monitors; i++) {
-				redraw_monitor(i);
+		/* a hotplug emits several notifies, reconfigure once per batch */
+		if (monitors_changed) {
+			update_monitors();
+			if (trace_recording()) {
+				record_layout();
 			}
-			last = now;
 		}
-		struct timespec ts = {0, 100000000};
-		nanosleep(&ts, NULL);
+		if (reload_pending) {
+			reload_pending = 0;
+			reload_config();
+		}
+		if (report_pending) {
+			report_pending = 0;
+			stats_report(stderr);
+		}
+		if (mem_report_pending && !dirty) {
+			mem_report_pending = 0;
+			mem_report(stderr);
+		}
+		/*
+		 * poll modules only when one is due; changed output repaints just its own slot
+		 * unless it changed width or something else already needs a whole frame
+		 */
+		int changed = replayed;
+		if (pfd[1].revents & POLLIN) {
+			changed |= modules_watch_read();
+		}
+		if (pfd[2].revents & (POLLIN | POLLHUP)) {
+			changed |= status_read();
+		}
+		if (pfd[3].revents & POLLIN) {
+			char buf[64];
+			while (read(child_pipe[0], buf, sizeof buf) > 0) {
+			}
+			modules_reap_actions();
+		}
+		/* a replay brings its own module output */
+		long long next_due = trace_replaying() ? -1 : modules_next_deadline();
+		if (next_due >= 0 && monotonic_ms() >= next_due) {
+			changed |= update_modules();
+			next_due = modules_next_deadline();
+		}
+		if (changed && trace_recording()) {
+			for (int i = 0; i < config.module_count; i++) {
+				if (config.modules[i].type != MODULE_WINDOW_TITLE) {
+					trace_record_module(i, config.modules[i].cached_output);
+				}
+			}
+		}
+		if (changed && ((dirty & DIRTY_BARS) || !redraw_module_slots())) {
+			dirty |= DIRTY_BARS;
+		}
+
+		/* one property read per changed atom and one frame for the whole batch */
+		if (dirty) {
+			update_workspaces(dirty);
+			update_active_window(dirty);
+			redraw_all();
+			dirty = 0;
+		}
+		if (trace_replaying()) {
+			trace_settle(dpy);
+			if (trace_finished()) {
+				return;
+			}
+		}
+		XFlush(dpy);
+#ifdef SXBAR_XCB
+		backend_flush();
+		int queued = backend_events_queued();
+#else
+		int queued = XEventsQueued(dpy, QueuedAlready);
+#endif
+
+		/* sleep until the X connection wakes us or the next module falls due */
+		int timeout = -1;
+		if (next_due >= 0) {
+			long long wait = next_due - monotonic_ms();
+			timeout = wait < 0 ? 0 : wait > 3600000 ? 3600000 : (int)wait;
+		}
+
+		/* marquee frames only touch the scrolling slots, never the rest of the bar */
+		if (marquee_active()) {
+			struct timespec mono;
+			clock_gettime(CLOCK_MONOTONIC, &mono);
+			long until = (next_frame.tv_sec - mono.tv_sec) * 1000 +
+				(next_frame.tv_nsec - mono.tv_nsec) / 1000000;
+			if (until <= 0) {
+				marquee_tick();
+				XFlush(dpy);
+				long step = 1000000000L / config.marquee_fps;
+				next_frame = mono;
+				next_frame.tv_nsec += step % 1000000000L;
+				next_frame.tv_sec += step / 1000000000L + next_frame.tv_nsec / 1000000000L;
+				next_frame.tv_nsec %= 1000000000L;
+				until = step / 1000000;
+			}
+			if (timeout < 0 || until < timeout) {
+				timeout = until;
+			}
+		}
+		if (trace_replaying()) {
+			int until = trace_timeout();
+			if (until >= 0 && (timeout < 0 || until < timeout)) {
+				timeout = until;
+			}
+		}
+		/* replies awaited while drawing may have queued events poll() can't see */
+		pfd[1].fd = modules_watch_fd();
+		pfd[1].revents = 0;
+		pfd[2].fd = status_fd();
+		pfd[2].revents = 0;
+		pfd[3].revents = 0;
+		poll(pfd, 4, queued ? 0 : timeout);
 	}
 }
 
-void setup(void)
+void set_bar_strut(Window win, int x, int y, int w, int h)
 {
-	if (!(dpy = XOpenDisplay(NULL))) {
-		errx(1, "can't open display");
+	int bw = config.border ? config.border_width : 0;
+	long strut[12] = {0};
+
+	switch (BAR_POSITION) {
+		case BAR_POS_BOTTOM:
+			strut[3] = h + bw + config.vertical_padding;
+			strut[10] = x;
+			strut[11] = x + w + 2 * bw - 1;
+			break;
+		case BAR_POS_TOP:
+			strut[2] = y + h + bw;
+			strut[8] = x;
+			strut[9] = x + w + 2 * bw - 1;
+			break;
+		case BAR_POS_LEFT:
+			strut[0] = w + bw + config.horizontal_padding;
+			strut[4] = y;
+			strut[5] = y + h + 2 * bw - 1;
+			break;
+		case BAR_POS_RIGHT:
+			strut[1] = w + bw + config.horizontal_padding;
+			strut[6] = y;
+			strut[7] = y + h + 2 * bw - 1;
+			break;
+		default: /* fallback to bottom */
+			strut[3] = h + bw + config.vertical_padding;
+			strut[10] = x;
+			strut[11] = x + w + 2 * bw - 1;
+			break;
 	}
-	root = XDefaultRootWindow(dpy);
-	scr = DefaultScreen(dpy);
+	XChangeProperty(
+			dpy, win, atoms[NET_WM_STRUT_PARTIAL], XA_CARDINAL, 32, PropModeReplace,
+			(unsigned char *)strut, 12
+			);
+}
+
+void setup(void)
+{
+	open_display();
 
 	for (int i = 0; i < LASTEvent; i++) {
 		evtable[i] = hdl_dummy;
 	}
 	evtable[Expose] = hdl_expose;
+	evtable[ButtonPress] = hdl_button;
 	evtable[PropertyNotify] = hdl_property;
 	XSelectInput(dpy, root, PropertyChangeMask);
+	xerrorxlib = XSetErrorHandler(xerror);
 
-	init_defaults();
-	char *cfgpath = get_config_path();
-	parse_config(cfgpath, &config);
-	free(cfgpath);
+	load_config();
+	if (stdin_mode && status_open(STDIN_FILENO) < 0) {
+		errx(1, "cannot read status from stdin");
+	}
+	if (trace_replaying()) {
+		/* bars go where the recording had them, the stand-in window starts out focused */
+		if (trace_initial_layout()) {
+			replay_layout = parse_layout(trace_initial_layout(), &replay_layout_count);
+		}
+		replay_win = XCreateSimpleWindow(dpy, root, 0, 0, 1, 1, 0, 0, 0);
+		XChangeProperty(dpy, root, atoms[NET_ACTIVE_WINDOW], XA_WINDOW, 32, PropModeReplace,
+				(unsigned char *)&replay_win, 1);
+	}
+	else {
+		modules_watch();
+	}
+	for (int i = 0; i < MAX_MONITORS; i++) {
+		ws_monitor[i] = -1;
+	}
+	update_workspaces(DIRTY_WS_CURRENT | DIRTY_WS_NAMES);
 	create_bars();
+	update_active_window(DIRTY_ACTIVE);
+	if (trace_recording()) {
+		record_layout();
+	}
+
+	int rr_error_base;
+	if (XRRQueryExtension(dpy, &randr_event_base, &rr_error_base)) {
+		XRRSelectInput(dpy, root, RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask |
+				RROutputChangeNotifyMask);
+	}
+	else {
+		randr_event_base = -1;
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = sighup;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGHUP, &sa, NULL);
+
+	/* a finished click action wakes the loop to refresh its module */
+	if (pipe(child_pipe) < 0) {
+		err(1, "pipe");
+	}
+	for (int i = 0; i < 2; i++) {
+		fcntl(child_pipe[i], F_SETFL, O_NONBLOCK);
+		fcntl(child_pipe[i], F_SETFD, FD_CLOEXEC);
+	}
+	sa.sa_handler = sigchld;
+	sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &sa, NULL);
+	sa.sa_flags = SA_RESTART;
+
+	if (stats_enabled()) {
+		sa.sa_handler = sigusr1;
+		sigaction(SIGUSR1, &sa, NULL);
+	}
+	if (mem_report_on) {
+		sa.sa_handler = sigusr2;
+		sigaction(SIGUSR2, &sa, NULL);
+		mem_report_pending = 1;
+	}
+}
+
+void sigchld(int sig)
+{
+	(void)sig;
+	int saved = errno;
+	/* a full pipe already has a wakeup pending */
+	ssize_t n = write(child_pipe[1], "", 1);
+	(void)n;
+	errno = saved;
+}
+
+void sighup(int sig)
+{
+	(void)sig;
+	reload_pending = 1;
+}
+
+void sigusr1(int sig)
+{
+	(void)sig;
+	report_pending = 1;
 }
 
-int xft_center_x(const char *s, int area_w, XftFont *f)
+void sigusr2(int sig)
 {
-	XGlyphInfo ext;
-	XftTextExtentsUtf8(dpy, f, (const FcChar8 *)s, strlen(s), &ext);
+	(void)sig;
+	mem_report_pending = 1;
+}
 
-	int avail = area_w - 2 * config.text_padding;
-	if (avail < 0) {
-		avail = 0;
+/* follow _NET_ACTIVE_WINDOW and feed the focused window's title to window_title modules */
+void update_active_window(unsigned int what)
+{
+	int wanted = False;
+	for (int i = 0; i < config.module_count; i++) {
+		if (config.modules[i].enabled && config.modules[i].type == MODULE_WINDOW_TITLE) {
+			wanted = True;
+		}
 	}
 
-	int cx = config.text_padding + ((avail - (int)ext.width) / 2) - (int)ext.x;
-	if (cx < 0) {
-		cx = 0;
+	if (what & DIRTY_ACTIVE) {
+		Window win = wanted ? get_active_window() : None;
+		/* never touch the event mask of our own bars */
+		if (find_window_monitor(win) >= 0) {
+			win = None;
+		}
+		if (win != active_win) {
+			if (active_win != None) {
+				XSelectInput(dpy, active_win, NoEventMask);
+			}
+			if (win != None) {
+				XSelectInput(dpy, win, PropertyChangeMask);
+			}
+			active_win = win;
+		}
 	}
-	return cx;
+	if (!wanted || !(what & (DIRTY_ACTIVE | DIRTY_TITLE))) {
+		return;
+	}
+
+	char *title = active_win != None ? get_window_title(active_win) : strdup("");
+	for (int i = 0; i < config.module_count; i++) {
+		Module *m = &config.modules[i];
+		if (m->enabled && m->type == MODULE_WINDOW_TITLE) {
+			module_set_output(m, title);
+		}
+	}
+	free(title);
 }
 
-int xft_text_width(const char *s)
+void update_monitors(void)
 {
-	XGlyphInfo ext;
-	XftTextExtentsUtf8(dpy, font, (const FcChar8 *)s, strlen(s), &ext);
+#ifdef SXBAR_CLIENT_RENDER
+	/* bars may move between slots, the next frame recreates the canvases */
+	free_canvases();
+#endif
+	int n = 0;
+	XineramaScreenInfo *mons = query_monitors(&n);
+	Window *nwin = malloc(n * sizeof *nwin);
+	Pixmap *nbuf = malloc(n * sizeof *nbuf);
+	int *reused = calloc(n_monitors, sizeof *reused);
+	int *placed = calloc(n, sizeof *placed);
+
+	/* bars whose monitor did not change are kept untouched */
+	for (int j = 0; j < n; j++) {
+		for (int i = 0; i < n_monitors; i++) {
+			if (reused[i] || monitors[i].x_org != mons[j].x_org ||
+				monitors[i].y_org != mons[j].y_org ||
+				monitors[i].width != mons[j].width ||
+				monitors[i].height != mons[j].height) {
+				continue;
+			}
+			nwin[j] = windows[i];
+			nbuf[j] = buffers[i];
+			reused[i] = placed[j] = 1;
+			break;
+		}
+	}
+
+	/* move leftover bars onto the remaining monitors */
+	for (int j = 0; j < n; j++) {
+		if (placed[j]) {
+			continue;
+		}
+		for (int i = 0; i < n_monitors; i++) {
+			if (reused[i]) {
+				continue;
+			}
+			int ox, oy, ow, oh;
+			int x, y, w, h;
+			bar_geometry(&monitors[i], &ox, &oy, &ow, &oh);
+			bar_geometry(&mons[j], &x, &y, &w, &h);
+
+			XMoveResizeWindow(dpy, windows[i], x, y, w, h);
+			set_bar_strut(windows[i], x, y, w, h);
+			nbuf[j] = buffers[i];
+			if (w != ow || h != oh) {
+				XFreePixmap(dpy, buffers[i]);
+				nbuf[j] = XCreatePixmap(dpy, windows[i], w, h, DefaultDepth(dpy, scr));
+			}
+			nwin[j] = windows[i];
+			reused[i] = placed[j] = 1;
+			break;
+		}
+	}
 
-	int ink_right = ext.x + (int)ext.width;
-	return ink_right > (int)ext.xOff ? ink_right : (int)ext.xOff;
+	/* whatever is still unclaimed belonged to an unplugged monitor */
+	for (int i = 0; i < n_monitors; i++) {
+		if (!reused[i]) {
+			XFreePixmap(dpy, buffers[i]);
+			XDestroyWindow(dpy, windows[i]);
+		}
+	}
+
+	free(windows);
+	free(buffers);
+	free(monitors);
+	windows = nwin;
+	buffers = nbuf;
+	monitors = mons;
+	n_monitors = n;
+
+	/* newly plugged monitors get fresh bars */
+	for (int j = 0; j < n; j++) {
+		if (!placed[j]) {
+			create_bar(j);
+		}
+	}
+	free(reused);
+	free(placed);
+
+	/* indices now name other monitors, every bar follows the global desktop again */
+	for (int i = 0; i < MAX_MONITORS; i++) {
+		ws_monitor[i] = -1;
+		segment_count[i] = 0;
+	}
+	primary_monitor = find_primary_monitor();
+	dirty |= DIRTY_BARS;
 }
 
-int xft_text_adv_v(const char *s)
+void update_workspaces(unsigned int what)
 {
-	XGlyphInfo ext;
-	XftFont *f = font_rotated ? font_rotated : font;
-	XftTextExtentsUtf8(dpy, f, (const FcChar8 *)s, strlen(s), &ext);
-
-	int adv = ext.yOff;
-	if (adv < 0) {
-		adv = -adv;
+	int prev = ws_current;
+#ifdef SXBAR_XCB
+	if (what & (DIRTY_WS_CURRENT | DIRTY_WS_NAMES)) {
+		char **old_names = ws_names;
+
+		/* one round-trip for both properties */
+		backend_read_workspaces(root, atoms[NET_CURRENT_DESKTOP], atoms[NET_DESKTOP_NAMES],
+				atoms[UTF8_STRING], (what & DIRTY_WS_CURRENT) ? &ws_current : NULL,
+				(what & DIRTY_WS_NAMES) ? &ws_names : NULL, &ws_name_count);
+		if (what & DIRTY_WS_NAMES) {
+			free(old_names);
+		}
 	}
+#else
+	if (what & DIRTY_WS_CURRENT) {
+		ws_current = get_current_workspace();
+	}
+	if (what & DIRTY_WS_NAMES) {
+		free(ws_names);
+		ws_names = get_workspace_name(&ws_name_count);
+	}
+#endif
+
+	/*
+	 * EWMH has a single current desktop: a switch is charged to the monitor under the
+	 * pointer, the others keep showing what they had
+	 */
+	if (config.ws_per_monitor && (what & DIRTY_WS_CURRENT) && ws_current != prev) {
+		int p = pointer_monitor();
+		if (p < 0) {
+			return;
+		}
+		for (int i = 0; i < n_monitors; i++) {
+			if (ws_monitor[i] < 0) {
+				ws_monitor[i] = prev;
+			}
+		}
+		ws_monitor[p] = ws_current;
+		if (what == DIRTY_WS_CURRENT) {
+			redraw_mask = 1u << p;
+		}
+	}
+}
 
-	int ink = ext.y + (int)ext.height;
-	if (ink > adv) {
-		adv = ink;
+/* the focused window may be destroyed before we stop watching it */
+int xerror(Display *d, XErrorEvent *ee)
+{
+	if (ee->error_code == BadWindow) {
+		return 0;
 	}
+	return xerrorxlib(d, ee);
+}
 
-	return adv;
+int xft_text_width(const char *s)
+{
+	return fonts_text_width(s);
 }
 
 int main(int ac, char **av)
 {
-	if (ac > 1) {
-		if (!strcmp(av[1], "-v") || !strcmp(av[1], "--version")) {
+#ifdef SXBAR_STATIC_CONFIG
+	const char *usage = "usage: sxbar [-v|--version] [--stdin] [--latency|--latency-sync]\n"
+		"             [--mem-report] [--bench-render frames [--dump-frame out.ppm]]\n"
+		"             [--record trace | --replay trace | --replay-fast trace]";
+#else
+	const char *usage = "usage: sxbar [-v|--version] [-c|--config file] [--check-config]\n"
+		"             [--stdin] [--latency|--latency-sync] [--mem-report]\n"
+		"             [--bench-render frames [--dump-frame out.ppm]]\n"
+		"             [--record trace | --replay trace | --replay-fast trace]";
+	int check = 0;
+#endif
+	int bench_frames = 0;
+	const char *dump_path = NULL;
+	const char *record_path = NULL;
+	const char *replay_path = NULL;
+	int replay_fast = 0;
+
+	for (int i = 1; i < ac; i++) {
+		if (!strcmp(av[i], "-v") || !strcmp(av[i], "--version")) {
 			printf("%s\n%s\n%s\n", SXBAR_VERSION, SXBAR_AUTHOR, SXBAR_LICINFO);
 			return 0;
 		}
-		errx(1, "usage: sxbar [-v|--version]");
+#ifndef SXBAR_STATIC_CONFIG
+		else if ((!strcmp(av[i], "-c") || !strcmp(av[i], "--config")) && i + 1 < ac) {
+			free(config_path);
+			config_path = strdup(av[++i]);
+		}
+		else if (!strcmp(av[i], "--check-config")) {
+			check = 1;
+			/* legacy form: --check-config file */
+			if (i + 1 < ac && av[i + 1][0] != '-') {
+				free(config_path);
+				config_path = strdup(av[++i]);
+			}
+		}
+#endif
+		else if (!strcmp(av[i], "--stdin")) {
+			stdin_mode = True;
+		}
+		else if (!strcmp(av[i], "--mem-report")) {
+			mem_report_on = True;
+		}
+		else if (!strcmp(av[i], "--latency")) {
+			stats_enable(0);
+		}
+		else if (!strcmp(av[i], "--latency-sync")) {
+			stats_enable(1);
+		}
+		else if (!strcmp(av[i], "--bench-render") && i + 1 < ac) {
+			bench_frames = atoi(av[++i]);
+			if (bench_frames <= 0) {
+				errx(1, "%s", usage);
+			}
+		}
+		else if (!strcmp(av[i], "--dump-frame") && i + 1 < ac) {
+			dump_path = av[++i];
+		}
+		else if (!strcmp(av[i], "--record") && i + 1 < ac) {
+			record_path = av[++i];
+		}
+		else if ((!strcmp(av[i], "--replay") || !strcmp(av[i], "--replay-fast")) && i + 1 < ac) {
+			replay_fast = !strcmp(av[i], "--replay-fast");
+			replay_path = av[++i];
+		}
+		else {
+			errx(1, "%s", usage);
+		}
+	}
+
+#ifndef SXBAR_STATIC_CONFIG
+	if (check) {
+		return check_config(config_path);
+	}
+#endif
+	if (bench_frames > 0 || dump_path) {
+		return bench_render(bench_frames > 0 ? bench_frames : 1, dump_path);
 	}
+
+	if (replay_path && (record_path || stdin_mode)) {
+		errx(1, "%s", usage);
+	}
+	if (record_path && trace_record_open(record_path) < 0) {
+		err(1, "%s", record_path);
+	}
+	/* meant for a throwaway server: the root window properties are overwritten */
+	if (replay_path && trace_replay_open(replay_path, replay_fast) < 0) {
+		err(1, "%s", replay_path);
+	}
+
 	setup();
 	run();
 
-	/* TODO?: never reached */
+	/* only a finished replay gets here */
+	trace_report(stdout);
+	free(replay_layout);
 	cleanup_resources();
+	trace_close();
 	return 0;
 }
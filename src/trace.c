@@ -0,0 +1,381 @@
+/*
+ * --record / --replay: a trace is one line per input that can make sxbar draw, stamped in
+ * microseconds since the recording started:
+ *
+ *     <us> <kind> <index>[ <value>]
+ *
+ * The value is escaped so it stays on one line (\\, \n and \xNN for other control bytes);
+ * a line without one clears a module. Replaying feeds the lines back in order, at the
+ * recorded pace or as fast as the bar settles, and measures how long each input took to
+ * reach the screen.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include <X11/Xlib.h>
+
+#include "trace.h"
+
+static const char *kind_names[TRACE_LAST] = {
+	[TRACE_MONITORS] = "monitors",
+	[TRACE_DESKTOP] = "desktop",
+	[TRACE_NAMES] = "names",
+	[TRACE_ACTIVE] = "active",
+	[TRACE_TITLE] = "title",
+	[TRACE_EXPOSE] = "expose",
+	[TRACE_MODULE] = "module",
+};
+
+/* recording */
+static FILE *out;
+static int64_t t_start;
+static char **last_module;
+static int last_module_count;
+
+/* replaying */
+static const char *replay_path;
+static int fast;
+static TraceEvent *events;
+static int n_events;
+static int cursor;
+static int first_pending = -1;
+static int64_t *injected;
+static int started;
+static struct rusage ru_start;
+
+static int painted;
+static unsigned long frames, slots, copies;
+static unsigned long skipped, coalesced;
+static int64_t *samples;
+static int n_samples;
+
+static int64_t mono_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int trace_record_open(const char *path)
+{
+	if (!(out = fopen(path, "w"))) {
+		return -1;
+	}
+	/* sxbar is usually stopped with a signal, every line has to be on disk by then */
+	setvbuf(out, NULL, _IOLBF, 0);
+	fprintf(out, "# sxbar trace\n");
+	t_start = mono_us();
+	return 0;
+}
+
+int trace_recording(void)
+{
+	return out != NULL;
+}
+
+void trace_record(int kind, int index, const char *data, size_t len)
+{
+	if (!out) {
+		return;
+	}
+	fprintf(out, "%lld %s %d", (long long)(mono_us() - t_start), kind_names[kind], index);
+	if (data) {
+		fputc(' ', out);
+		for (size_t i = 0; i < len; i++) {
+			unsigned char c = data[i];
+			if (c == '\\') {
+				fputs("\\\\", out);
+			}
+			else if (c == '\n') {
+				fputs("\\n", out);
+			}
+			else if (c < 0x20 || c == 0x7f) {
+				fprintf(out, "\\x%02x", c);
+			}
+			else {
+				fputc(c, out);
+			}
+		}
+	}
+	fputc('\n', out);
+}
+
+/* a module's output, logged only when it differs from what was logged for the slot last */
+void trace_record_module(int index, const char *text)
+{
+	if (!out) {
+		return;
+	}
+	if (index >= last_module_count) {
+		last_module = realloc(last_module, (index + 1) * sizeof *last_module);
+		memset(last_module + last_module_count, 0,
+				(index + 1 - last_module_count) * sizeof *last_module);
+		last_module_count = index + 1;
+	}
+	char *prev = last_module[index];
+	if ((!prev && !text) || (prev && text && !strcmp(prev, text))) {
+		return;
+	}
+	free(prev);
+	last_module[index] = text ? strdup(text) : NULL;
+	trace_record(TRACE_MODULE, index, text, text ? strlen(text) : 0);
+}
+
+static int hex_digit(char c)
+{
+	return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10
+		: c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+}
+
+/* undo the escaping in place, returns the decoded length */
+static size_t unescape(char *s)
+{
+	char *w = s;
+	for (char *r = s; *r; r++) {
+		if (*r != '\\' || !r[1]) {
+			*w++ = *r;
+		}
+		else if (r[1] == 'n') {
+			*w++ = '\n';
+			r++;
+		}
+		else if (r[1] == 'x' && hex_digit(r[2]) >= 0 && hex_digit(r[3]) >= 0) {
+			*w++ = hex_digit(r[2]) << 4 | hex_digit(r[3]);
+			r += 3;
+		}
+		else {
+			*w++ = r[1];
+			r++;
+		}
+	}
+	*w = '\0';
+	return w - s;
+}
+
+static int parse_line(char *line, TraceEvent *ev)
+{
+	line[strcspn(line, "\n")] = '\0';
+	char kind[16];
+	int used = 0;
+	if (sscanf(line, "%lld %15s %d%n", &ev->us, kind, &ev->index, &used) != 3) {
+		return -1;
+	}
+	ev->kind = -1;
+	for (int k = 0; k < TRACE_LAST; k++) {
+		if (!strcmp(kind, kind_names[k])) {
+			ev->kind = k;
+		}
+	}
+	if (ev->kind < 0) {
+		return -1;
+	}
+	ev->data = NULL;
+	ev->len = 0;
+	if (line[used] == ' ') {
+		ev->data = strdup(line + used + 1);
+		ev->len = unescape(ev->data);
+	}
+	return 0;
+}
+
+int trace_replay_open(const char *path, int as_fast_as_possible)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp) {
+		return -1;
+	}
+	char *line = NULL;
+	size_t cap = 0;
+	int lineno = 0;
+	while (getline(&line, &cap, fp) > 0) {
+		lineno++;
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+		events = realloc(events, (n_events + 1) * sizeof *events);
+		if (parse_line(line, &events[n_events]) < 0) {
+			errx(1, "%s:%d: not a trace line", path, lineno);
+		}
+		n_events++;
+	}
+	free(line);
+	fclose(fp);
+
+	replay_path = path;
+	fast = as_fast_as_possible;
+	injected = calloc(n_events ? n_events : 1, sizeof *injected);
+	/* the layout at the start of the recording is where the bars are created */
+	if (n_events && events[0].kind == TRACE_MONITORS) {
+		cursor = 1;
+	}
+	return 0;
+}
+
+int trace_replaying(void)
+{
+	return replay_path != NULL;
+}
+
+const char *trace_initial_layout(void)
+{
+	return cursor == 1 && events[0].data ? events[0].data : NULL;
+}
+
+/* the next event that is due now, NULL when there is none yet */
+const TraceEvent *trace_next(void)
+{
+	if (!started) {
+		started = 1;
+		t_start = mono_us();
+		getrusage(RUSAGE_SELF, &ru_start);
+	}
+	if (cursor >= n_events) {
+		return NULL;
+	}
+	int64_t now = mono_us();
+	/* flat out means one input at a time, each once the previous one reached the screen */
+	if (fast ? first_pending >= 0 : events[cursor].us > now - t_start) {
+		return NULL;
+	}
+	if (first_pending < 0) {
+		first_pending = cursor;
+	}
+	injected[cursor] = now;
+	return &events[cursor++];
+}
+
+/* milliseconds until trace_next() has something again, -1 once the trace is used up */
+int trace_timeout(void)
+{
+	if (cursor >= n_events) {
+		return -1;
+	}
+	if (fast) {
+		return 0;
+	}
+	int64_t wait = events[cursor].us - (mono_us() - t_start);
+	return wait <= 0 ? 0 : (int)((wait + 999) / 1000);
+}
+
+void trace_painted(int how)
+{
+	if (!replay_path) {
+		return;
+	}
+	painted = 1;
+	switch (how) {
+		case TRACE_FRAME: frames++; break;
+		case TRACE_SLOTS: slots++; break;
+		default: copies++; break;
+	}
+}
+
+/*
+ * end of a main loop iteration: inputs fed since the last one either made it to the screen,
+ * timed once the server has executed the drawing, or needed no redraw at all
+ */
+void trace_settle(Display *dpy)
+{
+	if (first_pending < 0) {
+		painted = 0;
+		return;
+	}
+	int n = cursor - first_pending;
+	if (painted) {
+		XSync(dpy, False);
+		int64_t now = mono_us();
+		samples = realloc(samples, (n_samples + n) * sizeof *samples);
+		for (int i = first_pending; i < cursor; i++) {
+			samples[n_samples++] = now - injected[i];
+		}
+		coalesced += n - 1;
+	}
+	else {
+		skipped += n;
+	}
+	first_pending = -1;
+	painted = 0;
+}
+
+int trace_finished(void)
+{
+	return replay_path && cursor >= n_events && first_pending < 0;
+}
+
+static int cmp_i64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static double percentile_ms(double p)
+{
+	return samples[(int)(p / 100.0 * (n_samples - 1) + 0.5)] / 1000.0;
+}
+
+static double tv_sec(struct timeval end, struct timeval start)
+{
+	return (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+}
+
+void trace_report(FILE *fp)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	double wall = (mono_us() - t_start) / 1e6;
+	double span = n_events ? events[n_events - 1].us / 1e6 : 0;
+
+	fprintf(fp, "trace         %s, %d events over %.2f s (%s)\n", replay_path, n_events, span,
+			fast ? "flat out" : "recorded pace");
+	fprintf(fp, "wall          %.2f s\n", wall);
+	fprintf(fp, "cpu           %.3f s user, %.3f s sys\n", tv_sec(ru.ru_utime, ru_start.ru_utime),
+			tv_sec(ru.ru_stime, ru_start.ru_stime));
+	fprintf(fp, "frames        %lu full, %lu slot repaints, %lu expose copies\n", frames, slots,
+			copies);
+	fprintf(fp, "skipped       %lu needed no redraw, %lu shared a redraw\n", skipped, coalesced);
+	if (n_samples) {
+		qsort(samples, n_samples, sizeof *samples, cmp_i64);
+		double sum = 0;
+		for (int i = 0; i < n_samples; i++) {
+			sum += samples[i];
+		}
+		fprintf(fp, "latency       n=%d mean %.2f p50 %.2f p90 %.2f p99 %.2f max %.2f (ms)\n",
+				n_samples, sum / n_samples / 1000.0, percentile_ms(50), percentile_ms(90),
+				percentile_ms(99), samples[n_samples - 1] / 1000.0);
+	}
+	fflush(fp);
+}
+
+void trace_close(void)
+{
+	if (out) {
+		fclose(out);
+		out = NULL;
+	}
+	for (int i = 0; i < last_module_count; i++) {
+		free(last_module[i]);
+	}
+	free(last_module);
+	last_module = NULL;
+	last_module_count = 0;
+
+	for (int i = 0; i < n_events; i++) {
+		free(events[i].data);
+	}
+	free(events);
+	events = NULL;
+	n_events = cursor = 0;
+	free(injected);
+	injected = NULL;
+	free(samples);
+	samples = NULL;
+	n_samples = 0;
+	replay_path = NULL;
+}
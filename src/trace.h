@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+#include <X11/Xlib.h>
+
+/* what a trace line changes; index is the monitor of an expose or the slot of a module */
+enum {
+	TRACE_MONITORS,
+	TRACE_DESKTOP,
+	TRACE_NAMES,
+	TRACE_ACTIVE,
+	TRACE_TITLE,
+	TRACE_EXPOSE,
+	TRACE_MODULE,
+	TRACE_LAST
+};
+
+/* how an event reached the screen */
+enum { TRACE_FRAME, TRACE_SLOTS, TRACE_COPY };
+
+typedef struct TraceEvent {
+	long long us;		/* since the recording started */
+	int kind;
+	int index;
+	char *data;			/* NULL when the line carries no value */
+	size_t len;
+} TraceEvent;
+
+int trace_record_open(const char *path);
+int trace_recording(void);
+void trace_record(int kind, int index, const char *data, size_t len);
+void trace_record_module(int index, const char *out);
+
+int trace_replay_open(const char *path, int fast);
+int trace_replaying(void);
+const char *trace_initial_layout(void);
+const TraceEvent *trace_next(void);
+int trace_timeout(void);
+void trace_painted(int how);
+void trace_settle(Display *dpy);
+int trace_finished(void);
+void trace_report(FILE *fp);
+
+void trace_close(void);